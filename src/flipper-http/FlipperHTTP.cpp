@@ -3,7 +3,7 @@ Author: JBlanked
 Github: https://github.com/jblanked/FlipperHTTP
 Info: This library is a wrapper around the HTTPClient library and is used to communicate with the FlipperZero over serial.
 Created: 2024-09-30
-Updated: 2026-04-07
+Updated: 2026-10-19
 */
 
 #include "FlipperHTTP.hpp"
@@ -146,56 +146,265 @@ void FlipperHTTP::setup()
     this->led.off();
     this->http = new HTTP(this->uart, &this->client);
     this->websocket = nullptr;
+    for (int i = 0; i < RFILE_MAX_HANDLES; i++)
+    {
+        this->rfiles[i] = nullptr;
+    }
+    this->parser = new ParseCache(this->uart);
+    this->sse = nullptr;
+    this->mqtt = nullptr;
+    this->poller = nullptr;
+    this->udp = nullptr;
+    this->sockets = nullptr;
 }
 
-// Main loop for flipper-http.ino that handles all of the commands
-void FlipperHTTP::loop()
+// Read exactly size raw bytes that follow a command line, returns false if they stop arriving
+bool FlipperHTTP::readUartBytes(uint8_t *buffer, size_t size)
 {
-#ifdef BOARD_VGM
-    // Check if there's incoming serial data
-    if (this->uart->available() > 0)
+    size_t received = 0;
+    unsigned long timeoutStart = millis();
+    while (received < size)
     {
-        if (this->use_led)
+        size_t avail = this->uart->available();
+        if (avail == 0)
         {
-            this->led.on();
+            if (millis() - timeoutStart > 2000)
+            {
+                return false;
+            }
+            delay(1);
+            continue;
         }
+        size_t toRead = avail < size - received ? avail : size - received;
+        if (toRead > 255) // UART::readBytes reports at most 255 bytes per call
+            toRead = 255;
+        received += this->uart->readBytes(buffer + received, (uint8_t)toRead);
+        timeoutStart = millis();
+    }
+    return true;
+}
 
-        // Read the incoming serial data until newline
-        String _data = this->uart->readSerialLine();
+// Read and drop raw bytes that follow a command line, so a refused command doesn't leave them to be read as commands
+bool FlipperHTTP::discardUartBytes(size_t size)
+{
+    uint8_t scratch[64];
+    while (size > 0)
+    {
+        size_t piece = size < sizeof(scratch) ? size : sizeof(scratch);
+        if (!this->readUartBytes(scratch, piece))
+        {
+            return false;
+        }
+        size -= piece;
+    }
+    return true;
+}
+
+// Collect the optional "headers" object of a command, the keys and values point into doc.
+// Returns the number of headers, or -1 after an [ERROR] if there are more than maxHeaders
+int FlipperHTTP::collectHeaders(JsonDocument &doc, const char *keys[], const char *values[], int maxHeaders)
+{
+    int count = 0;
+    JsonObject headers = doc["headers"];
+    for (JsonPair header : headers)
+    {
+        if (count >= maxHeaders)
+        {
+            char message[64];
+            snprintf(message, sizeof(message), "[ERROR] Too many headers, at most %d are supported.", maxHeaders);
+            this->uart->println(message);
+            return -1;
+        }
+        keys[count] = header.key().c_str();
+        values[count] = header.value().as<const char *>();
+        count++;
+    }
+    return count;
+}
+
+#ifdef BOARD_VGM
+// Copy the bytes waiting on from to to, without waiting for more
+void FlipperHTTP::relayBytes(UART *from, UART *to)
+{
+    size_t count = from->available();
+    if (count == 0)
+    {
+        return;
+    }
+    if (this->use_led)
+    {
+        this->led.on();
+    }
+    uint8_t buffer[64];
+    while (count > 0)
+    {
+        size_t piece = count < sizeof(buffer) ? count : sizeof(buffer);
+        piece = from->readBytes(buffer, piece);
+        if (piece == 0)
+        {
+            break;
+        }
+        to->write(buffer, piece);
+        count -= piece;
+    }
+    if (this->use_led)
+    {
+        this->led.off();
+    }
+}
+#endif
 
-        // send to ESP32
-        this->uart_2->println(_data);
+// Keep the last HTTP response so [PARSE/LOAD] can parse it without sending it back over UART.
+// Only requests sent with "retain":true keep it, any other request frees the one kept before
+void FlipperHTTP::retainResponse(const String &response, bool retain)
+{
+    if (retain && response.length() <= PARSE_MAX_RETAINED)
+    {
+        this->lastResponse = response;
+    }
+    else
+    {
+        this->lastResponse = String(); // moving an empty String in releases the buffer, assigning "" would keep it
+    }
+}
 
-        // Wait for response from ESP32
-        String _response = this->uart_2->readSerialLine();
+#ifndef BOARD_BW16
+bool FlipperHTTP::spoolUpload(size_t size, uint32_t &crc)
+{
+    if (this->storage.freeSpace() < size)
+    {
+        this->uart->println(F("[ERROR] Not enough flash space to spool the upload."));
+        return false;
+    }
+    File file = this->storage.open(uploadSpoolFilePath, "w");
+    if (!file)
+    {
+        this->uart->println(F("[ERROR] Failed to create the spool file."));
+        return false;
+    }
 
-        // Send response back to Flipper
-        this->uart->println(_response);
+    // Signal the UART device that we are ready for raw bytes
+    this->uart->println(F("[FILE/READY]"));
+    this->uart->flush();
 
-        if (this->use_led)
+    uint8_t buf[MAX_CHUNK_SIZE];
+    size_t remaining = size;
+    unsigned long timeoutStart = millis();
+    crc = 0;
+    while (remaining > 0)
+    {
+        size_t avail = this->uart->available();
+        if (avail > 0)
         {
-            this->led.off();
+            size_t toRead = avail < remaining ? avail : remaining;
+            if (toRead > sizeof(buf))
+                toRead = sizeof(buf);
+            size_t bytesRead = this->uart->readBytes(buf, (uint8_t)toRead);
+            if (file.write(buf, bytesRead) != bytesRead)
+            {
+                file.close();
+                this->storage.remove(uploadSpoolFilePath);
+                this->uart->println(F("[ERROR] Failed to write the spool file."));
+                return false;
+            }
+            crc = commonCrc32(buf, bytesRead, crc);
+            remaining -= bytesRead;
+            timeoutStart = millis();
+        }
+        else
+        {
+            if (millis() - timeoutStart > 5000)
+            {
+                file.close();
+                this->storage.remove(uploadSpoolFilePath);
+                this->uart->println(F("[ERROR] Upload timed out waiting for data."));
+                return false;
+            }
+            delay(1);
         }
     }
-    else if (this->uart_2->available() > 0)
+    file.close();
+
+    // Read the spool back so a bad flash write is caught before anything is sent
+    file = this->storage.open(uploadSpoolFilePath, "r");
+    uint32_t storedCrc = 0;
+    size_t storedSize = 0;
+    while (file && file.available())
     {
-        if (this->use_led)
+        size_t bytesRead = file.read(buf, sizeof(buf));
+        if (bytesRead == 0)
         {
-            this->led.on();
+            break;
         }
+        storedCrc = commonCrc32(buf, bytesRead, storedCrc);
+        storedSize += bytesRead;
+    }
+    if (file)
+    {
+        file.close();
+    }
+    if (storedSize != size || storedCrc != crc)
+    {
+        this->storage.remove(uploadSpoolFilePath);
+        this->uart->println(F("[ERROR] Spool file failed the CRC check."));
+        return false;
+    }
+    return true;
+}
+#endif
 
-        // Read the incoming serial data until newline
-        String _data = this->uart_2->readSerialLine();
+// Main loop for flipper-http.ino that handles all of the commands
+void FlipperHTTP::loop()
+{
+#ifdef BOARD_VGM
+    // The VGM only relays between the Flipper and the ESP32. Bytes are passed through as they arrive,
+    // without splitting lines or waiting for a reply, so raw payloads ([UDP/SEND], [SOCKET/BINARY],
+    // [TCP/START]) and commands that send no reply go through unchanged
+    this->relayBytes(this->uart, this->uart_2);
+    this->relayBytes(this->uart_2, this->uart);
+#else
+    // Keep the MQTT session alive and forward incoming publishes between commands
+    if (this->mqtt)
+    {
+        this->mqtt->loop();
+    }
 
-        // send to Flipper
-        this->uart->println(_data);
+    // Run the device-side polls that are due
+    if (this->poller)
+    {
+        this->poller->loop();
+    }
 
-        if (this->use_led)
+    // Forward Server-Sent Events that arrived, reconnecting when the stream dropped
+    if (this->sse)
+    {
+        this->sse->loop();
+    }
+
+    // Forward UDP datagrams that arrived
+    if (this->udp)
+    {
+        this->udp->loop();
+    }
+
+    // Forward WebSocket messages of the sessions opened with [SOCKET/OPEN]
+    if (this->sockets)
+    {
+        this->sockets->loop();
+    }
+
+    // Fetch the next block of a remote file read sequentially, only while no command is waiting
+    if (!this->uart->available())
+    {
+        for (int i = 0; i < RFILE_MAX_HANDLES; i++)
         {
-            this->led.off();
+            if (this->rfiles[i] && this->rfiles[i]->prefetch())
+            {
+                break; // one block per pass
+            }
         }
     }
-#else
+
     // Check if there's incoming serial data
     if (this->uart->available())
     {
@@ -215,7 +424,7 @@ void FlipperHTTP::loop()
         switch (commandType)
         {
         case COMMAND_TYPE_LIST:
-            this->uart->println(F("[LIST], [PING], [REBOOT], [WIFI/IP], [WIFI/SCAN], [WIFI/SAVE], [WIFI/CONNECT], [WIFI/DISCONNECT], [WIFI/LIST], [GET], [GET/HTTP], [POST/HTTP], [PUT/HTTP], [DELETE/HTTP], [GET/BYTES], [POST/BYTES], [POST/FILE], [PARSE], [PARSE/ARRAY], [LED/ON], [LED/OFF], [IP/ADDRESS], [WIFI/AP], [VERSION], [DEAUTH], [WIFI/STATUS], [WIFI/SSID], [BOARD/NAME]"));
+            this->uart->println(F("[LIST], [PING], [REBOOT], [WIFI/IP], [WIFI/SCAN], [WIFI/SAVE], [WIFI/CONNECT], [WIFI/DISCONNECT], [WIFI/LIST], [GET], [GET/HTTP], [POST/HTTP], [PUT/HTTP], [DELETE/HTTP], [GET/BYTES], [POST/BYTES], [POST/FILE], [PARSE], [PARSE/ARRAY], [LED/ON], [LED/OFF], [IP/ADDRESS], [WIFI/AP], [VERSION], [DEAUTH], [WIFI/STATUS], [WIFI/SSID], [BOARD/NAME], [SOCKET/START], [SOCKET/STOP], [RFILE/OPEN], [RFILE/READ], [RFILE/CLOSE], [HTTP/PREWARM], [GET/JSONPATH], [PARSE/LOAD], [PARSE/GET], [PARSE/FREE], [FILE/READ], [SSE/START], [SSE/STOP], [MQTT/CONNECT], [MQTT/SUB], [MQTT/PUB], [MQTT/DISCONNECT], [POLL/START], [POLL/STOP], [UDP/BIND], [UDP/SEND], [UDP/CLOSE], [TCP/START], [SOCKET/OPEN], [SOCKET/SEND], [SOCKET/CLOSE]"));
             break;
         case COMMAND_TYPE_PING:
             this->uart->println("[PONG]");
@@ -372,6 +581,7 @@ void FlipperHTTP::loop()
 
             // GET request
             String getData = this->http->request("GET", url);
+            this->retainResponse(getData, false);
             if (getData != "")
             {
                 this->uart->println(getData);
@@ -418,23 +628,25 @@ void FlipperHTTP::loop()
             String url = doc["url"];
 
             // Extract headers if available
-            const char *headerKeys[10];
-            const char *headerValues[10];
-            int headerSize = 0;
+            const char *headerKeys[HTTP_MAX_HEADERS];
+            const char *headerValues[HTTP_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, HTTP_MAX_HEADERS);
+            if (headerSize < 0)
+            {
+                this->led.off();
+                return;
+            }
 
-            if (doc["headers"])
+            // Optional ArduinoJson filter so only the requested fields are sent back
+            JsonDocument filter;
+            if (doc["filter"])
             {
-                JsonObject headers = doc["headers"];
-                for (JsonPair header : headers)
-                {
-                    headerKeys[headerSize] = header.key().c_str();
-                    headerValues[headerSize] = header.value();
-                    headerSize++;
-                }
+                filter.set(doc["filter"]);
             }
 
             // GET request
-            String getData = this->http->request("GET", url, "", headerKeys, headerValues, headerSize);
+            String getData = this->http->request("GET", url, "", headerKeys, headerValues, headerSize, doc["filter"] ? &filter : nullptr);
+            this->retainResponse(getData, doc["retain"] | false);
             if (getData != "")
             {
                 this->uart->println(getData);
@@ -482,23 +694,25 @@ void FlipperHTTP::loop()
             String payload = doc["payload"];
 
             // Extract headers if available
-            const char *headerKeys[10];
-            const char *headerValues[10];
-            int headerSize = 0;
+            const char *headerKeys[HTTP_MAX_HEADERS];
+            const char *headerValues[HTTP_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, HTTP_MAX_HEADERS);
+            if (headerSize < 0)
+            {
+                this->led.off();
+                return;
+            }
 
-            if (doc["headers"])
+            // Optional ArduinoJson filter so only the requested fields are sent back
+            JsonDocument filter;
+            if (doc["filter"])
             {
-                JsonObject headers = doc["headers"];
-                for (JsonPair header : headers)
-                {
-                    headerKeys[headerSize] = header.key().c_str();
-                    headerValues[headerSize] = header.value();
-                    headerSize++;
-                }
+                filter.set(doc["filter"]);
             }
 
             // POST request
-            String postData = this->http->request("POST", url, payload, headerKeys, headerValues, headerSize);
+            String postData = this->http->request("POST", url, payload, headerKeys, headerValues, headerSize, doc["filter"] ? &filter : nullptr);
+            this->retainResponse(postData, doc["retain"] | false);
             if (postData != "")
             {
                 this->uart->println(postData);
@@ -546,23 +760,18 @@ void FlipperHTTP::loop()
             String payload = doc["payload"];
 
             // Extract headers if available
-            const char *headerKeys[10];
-            const char *headerValues[10];
-            int headerSize = 0;
-
-            if (doc["headers"])
+            const char *headerKeys[HTTP_MAX_HEADERS];
+            const char *headerValues[HTTP_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, HTTP_MAX_HEADERS);
+            if (headerSize < 0)
             {
-                JsonObject headers = doc["headers"];
-                for (JsonPair header : headers)
-                {
-                    headerKeys[headerSize] = header.key().c_str();
-                    headerValues[headerSize] = header.value();
-                    headerSize++;
-                }
+                this->led.off();
+                return;
             }
 
             // PUT request
             String putData = this->http->request("PUT", url, payload, headerKeys, headerValues, headerSize);
+            this->retainResponse(putData, doc["retain"] | false);
             if (putData != "")
             {
                 this->uart->println(putData);
@@ -610,23 +819,18 @@ void FlipperHTTP::loop()
             String payload = doc["payload"];
 
             // Extract headers if available
-            const char *headerKeys[10];
-            const char *headerValues[10];
-            int headerSize = 0;
-
-            if (doc["headers"])
+            const char *headerKeys[HTTP_MAX_HEADERS];
+            const char *headerValues[HTTP_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, HTTP_MAX_HEADERS);
+            if (headerSize < 0)
             {
-                JsonObject headers = doc["headers"];
-                for (JsonPair header : headers)
-                {
-                    headerKeys[headerSize] = header.key().c_str();
-                    headerValues[headerSize] = header.value();
-                    headerSize++;
-                }
+                this->led.off();
+                return;
             }
 
             // DELETE request
             String deleteData = this->http->request("DELETE", url, payload, headerKeys, headerValues, headerSize);
+            this->retainResponse(deleteData, doc["retain"] | false);
             if (deleteData != "")
             {
                 this->uart->println(deleteData);
@@ -673,23 +877,32 @@ void FlipperHTTP::loop()
             String url = doc["url"];
 
             // Extract headers if available
-            const char *headerKeys[10];
-            const char *headerValues[10];
-            int headerSize = 0;
+            const char *headerKeys[HTTP_MAX_HEADERS];
+            const char *headerValues[HTTP_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, HTTP_MAX_HEADERS);
+            if (headerSize < 0)
+            {
+                this->led.off();
+                return;
+            }
 
-            if (doc["headers"])
+            // Optional byte range and automatic resume after a dropped connection
+            size_t offset = doc["offset"].as<size_t>();
+            size_t length = doc["length"].as<size_t>();
+            bool resume = doc["resume"] | false;
+
+            // Pull the whole body into flash and close the socket, [FILE/READ] drains it later
+            if (doc["to_device"] | false)
             {
-                JsonObject headers = doc["headers"];
-                for (JsonPair header : headers)
+                if (!this->http->download("GET", url, "", headerKeys, headerValues, headerSize, downloadFilePath, offset, length))
                 {
-                    headerKeys[headerSize] = header.key().c_str();
-                    headerValues[headerSize] = header.value();
-                    headerSize++;
+                    this->uart->println(F("[ERROR] GET request failed or returned empty data."));
                 }
+                break;
             }
 
             // GET request
-            if (!this->http->stream("GET", url, "", headerKeys, headerValues, headerSize))
+            if (!this->http->stream("GET", url, "", headerKeys, headerValues, headerSize, offset, length, resume))
             {
                 this->uart->println(F("[ERROR] GET request failed or returned empty data."));
             }
@@ -729,19 +942,13 @@ void FlipperHTTP::loop()
             String payload = doc["payload"];
 
             // Extract headers if available
-            const char *headerKeys[10];
-            const char *headerValues[10];
-            int headerSize = 0;
-
-            if (doc["headers"])
+            const char *headerKeys[HTTP_MAX_HEADERS];
+            const char *headerValues[HTTP_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, HTTP_MAX_HEADERS);
+            if (headerSize < 0)
             {
-                JsonObject headers = doc["headers"];
-                for (JsonPair header : headers)
-                {
-                    headerKeys[headerSize] = header.key().c_str();
-                    headerValues[headerSize] = header.value();
-                    headerSize++;
-                }
+                this->led.off();
+                return;
             }
 
             // POST request
@@ -774,35 +981,98 @@ void FlipperHTTP::loop()
                 return;
             }
 
-            // Require url and size; content_type is optional (defaults to application/octet-stream)
-            if (!doc["url"] || !doc["size"])
+            // Require url; content_type is optional (defaults to application/octet-stream)
+            // and without size the bytes are sent as length-prefixed chunks
+            if (!doc["url"])
             {
-                this->uart->println(F("[ERROR] JSON does not contain url or size."));
+                this->uart->println(F("[ERROR] JSON does not contain url."));
                 this->led.off();
                 return;
             }
             String url = doc["url"];
-            size_t fileSize = doc["size"].as<size_t>();
+            size_t fileSize = doc["size"] | 0;
             String contentType = doc["content_type"] | "application/octet-stream";
 
+            // Optional multipart/form-data: extra text fields plus the file part.
+            // Values are kept as text, so numbers and booleans are sent the way they were written
+            const char *fieldKeys[10];
+            const char *fieldValues[10];
+            String fieldTexts[10];
+            int fieldSize = 0;
+            const char *fileField = doc["field_name"] | "file";
+            const char *fileName = doc["filename"] | (const char *)nullptr;
+
+            if (doc["fields"])
+            {
+                JsonObject fields = doc["fields"];
+                for (JsonPair field : fields)
+                {
+                    if (fieldSize >= 10)
+                    {
+                        break;
+                    }
+                    fieldKeys[fieldSize] = field.key().c_str();
+                    fieldTexts[fieldSize] = field.value().as<String>();
+                    fieldValues[fieldSize] = fieldTexts[fieldSize].c_str();
+                    fieldSize++;
+                }
+                if (!fileName)
+                {
+                    fileName = "file";
+                }
+            }
+
             // Extract optional headers
-            const char *headerKeys[10];
-            const char *headerValues[10];
-            int headerSize = 0;
+            const char *headerKeys[HTTP_MAX_HEADERS];
+            const char *headerValues[HTTP_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, HTTP_MAX_HEADERS);
+            if (headerSize < 0)
+            {
+                this->led.off();
+                return;
+            }
 
-            if (doc["headers"])
+            // Store-and-forward: receive the whole file into flash first, then upload it at WiFi speed
+            if (doc["spool"] | false)
             {
-                JsonObject headers = doc["headers"];
-                for (JsonPair header : headers)
+#ifdef BOARD_BW16
+                this->uart->println(F("[ERROR] Spooled uploads are not supported on BW16."));
+#else
+                if (fileSize == 0)
                 {
-                    headerKeys[headerSize] = header.key().c_str();
-                    headerValues[headerSize] = header.value();
-                    headerSize++;
+                    this->uart->println(F("[ERROR] Spooled uploads require size."));
+                    this->led.off();
+                    return;
+                }
+                uint32_t crc = 0;
+                if (!this->spoolUpload(fileSize, crc))
+                {
+                    // error is handled by class
+                    break;
+                }
+                if (doc["crc32"] && doc["crc32"].as<uint32_t>() != crc)
+                {
+                    this->storage.remove(uploadSpoolFilePath);
+                    this->uart->println(F("[ERROR] Spooled file does not match crc32."));
+                    break;
+                }
+
+                // The device may disconnect now, the response still follows as [POST/SUCCESS]...[POST/END]
+                char spooledResponse[96];
+                snprintf(spooledResponse, sizeof(spooledResponse), "[FILE/SPOOLED]{\"size\":%lu,\"crc32\":%lu}", (unsigned long)fileSize, (unsigned long)crc);
+                this->uart->println(spooledResponse);
+
+                if (!this->http->streamUpload("POST", url, fileSize, contentType, headerKeys, headerValues, headerSize, fieldKeys, fieldValues, fieldSize, fileField, fileName, uploadSpoolFilePath))
+                {
+                    this->uart->println(F("[ERROR] File upload failed."));
                 }
+                this->storage.remove(uploadSpoolFilePath);
+#endif
+                break;
             }
 
             // Upload: connect, stream bytes from UART to HTTP body, return response
-            if (!this->http->streamUpload("POST", url, fileSize, contentType, headerKeys, headerValues, headerSize))
+            if (!this->http->streamUpload("POST", url, fileSize, contentType, headerKeys, headerValues, headerSize, fieldKeys, fieldValues, fieldSize, fileField, fileName))
             {
                 this->uart->println(F("[ERROR] File upload failed."));
             }
@@ -1069,6 +1339,7 @@ void FlipperHTTP::loop()
             String path = "/";
 
             // Remove protocol ("ws://" or "wss://")
+            bool secure = false;
             if (fullUrl.startsWith("ws://"))
             {
                 fullUrl = fullUrl.substring(5);
@@ -1076,6 +1347,7 @@ void FlipperHTTP::loop()
             else if (fullUrl.startsWith("wss://"))
             {
                 fullUrl = fullUrl.substring(6);
+                secure = true;
             }
 
             // Look for the first '/' that separates the server name from the path.
@@ -1092,19 +1364,13 @@ void FlipperHTTP::loop()
             }
 
             // Extract headers if available
-            int headerSize = 0;
             const char *headerKeys[10];
             const char *headerValues[10];
-
-            if (doc["headers"])
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, 10);
+            if (headerSize < 0)
             {
-                JsonObject headers = doc["headers"];
-                for (JsonPair kv : headers)
-                {
-                    headerKeys[headerSize] = kv.key().c_str();
-                    headerValues[headerSize] = kv.value().as<const char *>();
-                    headerSize++;
-                }
+                this->led.off();
+                return;
             }
 
             if (!this->websocket)
@@ -1119,7 +1385,11 @@ void FlipperHTTP::loop()
                 return;
             }
 
-            if (!this->websocket->connect(serverName.c_str(), port, path.c_str(), headerKeys, headerValues, headerSize))
+            // permessage-deflate with a 2^window_bits window, no_context_takeover trades ratio for memory
+            uint8_t deflateBits = (doc["deflate"] | false) ? (doc["window_bits"] | 10) : 0;
+            this->websocket->setDeflate(deflateBits, doc["no_context_takeover"] | false);
+
+            if (!this->websocket->connect(serverName.c_str(), port, path.c_str(), headerKeys, headerValues, headerSize, secure))
             {
                 char headerResponse[128];
                 snprintf(headerResponse, sizeof(headerResponse), "[ERROR] Failed to connect WebSocket to %s:%d%s", serverName.c_str(), port, path.c_str());
@@ -1128,43 +1398,89 @@ void FlipperHTTP::loop()
                 return;
             }
 
-            this->uart->println(F("[SOCKET/CONNECTED]"));
+            // Keepalive pings find dead peers and keep NAT mappings open, 0 disables them
+            uint32_t pingInterval = doc["ping_interval"] | 20000;
+            uint32_t pongTimeout = doc["pong_timeout"] | 10000;
+            this->websocket->setKeepAlive(pingInterval, pongTimeout);
 
-            delay(100);
+            // Optionally batch lines for up to coalesce_ms so they leave in one write
+            this->websocket->setCoalesce(doc["coalesce_ms"] | 0, doc["coalesce_bytes"] | WS_COALESCE_SIZE);
 
-            // Check if a message is available from the server:
-            String receivedMessage = this->websocket->recv();
-            if (this->websocket->isConnected() && receivedMessage.length() > 0)
-            {
-                // Read the message from the server
-                this->uart->println(receivedMessage);
-            }
+            this->uart->println(F("[SOCKET/CONNECTED]"));
 
-            // Wait for incoming serial/client data, and send back-n-forth
-            String uartMessage = "";
-            String wsMessage = "";
+            // Text messages travel as lines. Binary messages travel as [SOCKET/BINARY]{"length":n}
+            // followed by exactly n raw bytes, in both directions. An inbound binary message the
+            // connection drops partway through is padded with zeros to n, then an [ERROR] line follows.
+            uint8_t buffer[MAX_CHUNK_SIZE];
             while (this->websocket->isConnected())
             {
-                // Check if there's incoming serial data
-                if (this->uart->available() > 0)
+                if (!this->websocket->service())
+                {
+                    this->uart->println(F("[ERROR] WebSocket connection lost."));
+                    break;
+                }
+                uint32_t rtt;
+                if (this->websocket->takeRtt(rtt))
+                {
+                    this->uart->println("[SOCKET/RTT]{\"ms\":" + String(rtt) + "}");
+                }
+
+                bool uartReady = this->uart->available() > 0 && !this->websocket->queueFull();
+                bool socketReady = this->websocket->available();
+                if (!uartReady && !socketReady)
+                {
+                    delay(1); // nothing to do, let the core idle instead of spinning
+                    continue;
+                }
+
+                // Check if there's incoming serial data, a full queue leaves it waiting in the UART buffer
+                if (uartReady)
                 {
                     // Read the incoming serial data until newline
-                    uartMessage = this->uart->readSerialLine();
+                    String uartMessage = this->uart->readSerialLine();
                     if (uartMessage.startsWith("[SOCKET/STOP]"))
                     {
+                        this->websocket->flush();
                         break;
                     }
-                    this->websocket->send(uartMessage);
-                    uartMessage = ""; // Clear the message after sending
+                    if (uartMessage.startsWith("[SOCKET/BINARY]"))
+                    {
+                        this->websocket->flush(); // keep the order of queued text
+                        JsonDocument frame;
+                        deserializeJson(frame, uartMessage.substring(strlen("[SOCKET/BINARY]")));
+                        size_t length = frame["length"] | 0;
+
+                        // Forward the bytes as they arrive, as fragments of one message
+                        size_t sent = 0;
+                        do
+                        {
+                            size_t piece = length - sent < sizeof(buffer) ? length - sent : sizeof(buffer);
+                            if (!this->readUartBytes(buffer, piece))
+                            {
+                                this->uart->println(F("[ERROR] Failed to receive binary message."));
+                                this->websocket->stop(); // a half-sent message cannot be taken back
+                                break;
+                            }
+                            sent += piece;
+                            this->websocket->sendFragment(buffer, piece, true, sent == length);
+                        } while (sent < length);
+                    }
+                    else
+                    {
+                        this->websocket->queue(uartMessage);
+                    }
                 }
 
-                // Check if there's incoming websocket data
-                wsMessage = this->websocket->recv();
-                if (wsMessage.length() > 0)
+                // Check if there's incoming websocket data, copied to UART without a String
+                bool binary;
+                int length = socketReady ? this->websocket->recv(buffer, sizeof(buffer), binary) : -1;
+                if (length >= 0)
                 {
-                    // Read the message from the server
-                    this->uart->println(wsMessage);
-                    wsMessage = ""; // Clear the message after printing
+                    if (binary)
+                    {
+                        this->uart->println("[SOCKET/BINARY]{\"length\":" + String(length) + "}");
+                    }
+                    this->websocket->forwardMessage(this->uart, buffer, sizeof(buffer), length, binary, binary);
                 }
             }
 
@@ -1176,6 +1492,1199 @@ void FlipperHTTP::loop()
         case COMMAND_TYPE_SOCKET_STOP:
             // nothing to do..
             break;
+        case COMMAND_TYPE_RFILE_OPEN:
+        {
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            // Extract the JSON by removing the command part
+            String jsonData = _data.substring(strlen("[RFILE/OPEN]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->print(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            // Extract values from JSON
+            if (!doc["url"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain url."));
+                this->led.off();
+                return;
+            }
+            String url = doc["url"];
+
+            // Extract headers if available
+            const char *headerKeys[HTTP_MAX_HEADERS];
+            const char *headerValues[HTTP_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, HTTP_MAX_HEADERS);
+            if (headerSize < 0)
+            {
+                this->led.off();
+                return;
+            }
+
+            // Find a free handle
+            int handle = -1;
+            for (int i = 0; i < RFILE_MAX_HANDLES; i++)
+            {
+                if (!this->rfiles[i])
+                {
+                    handle = i;
+                    break;
+                }
+            }
+            if (handle == -1)
+            {
+                this->uart->println(F("[ERROR] Too many remote files open."));
+                this->led.off();
+                return;
+            }
+
+            RemoteFile *rfile = new RemoteFile(this->uart, this->http);
+            if (!rfile)
+            {
+                this->uart->println(F("[ERROR] Failed to allocate remote file."));
+                this->led.off();
+                return;
+            }
+            if (!rfile->open(url, headerKeys, headerValues, headerSize))
+            {
+                delete rfile;
+                this->led.off();
+                return; // error is handled by class
+            }
+            this->rfiles[handle] = rfile;
+
+            char response[96];
+            snprintf(response, sizeof(response), "[RFILE/SUCCESS]{\"handle\":%d,\"size\":%ld}", handle, rfile->size()); // -1 when the server doesn't give the size
+            this->uart->println(response);
+            break;
+        }
+        case COMMAND_TYPE_RFILE_READ:
+        {
+            // Extract the JSON by removing the command part
+            String jsonData = _data.substring(strlen("[RFILE/READ]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->print(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            // Extract values from JSON
+            int handle = doc["handle"] | -1;
+            if (handle < 0 || handle >= RFILE_MAX_HANDLES || !this->rfiles[handle])
+            {
+                this->uart->println(F("[ERROR] Invalid remote file handle."));
+                this->led.off();
+                return;
+            }
+            if (!doc["length"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain length."));
+                this->led.off();
+                return;
+            }
+            size_t offset = doc["offset"].as<size_t>();
+            size_t length = doc["length"].as<size_t>();
+
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            this->rfiles[handle]->read(offset, length); // error is handled by class
+            break;
+        }
+        case COMMAND_TYPE_RFILE_CLOSE:
+        {
+            // Extract the JSON by removing the command part
+            String jsonData = _data.substring(strlen("[RFILE/CLOSE]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->print(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            int handle = doc["handle"] | -1;
+            if (handle < 0 || handle >= RFILE_MAX_HANDLES || !this->rfiles[handle])
+            {
+                this->uart->println(F("[ERROR] Invalid remote file handle."));
+                this->led.off();
+                return;
+            }
+
+            delete this->rfiles[handle];
+            this->rfiles[handle] = nullptr;
+            this->uart->println(F("[SUCCESS] Remote file closed."));
+            break;
+        }
+        case COMMAND_TYPE_HTTP_PREWARM:
+        {
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            // Extract the JSON by removing the command part
+            String jsonData = _data.substring(strlen("[HTTP/PREWARM]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->print(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            // Extract values from JSON
+            if (!doc["hosts"] || !doc["hosts"].is<JsonArray>())
+            {
+                this->uart->println(F("[ERROR] JSON does not contain hosts."));
+                this->led.off();
+                return;
+            }
+
+            const char *hosts[10];
+            int hostCount = 0;
+            for (JsonVariant host : doc["hosts"].as<JsonArray>())
+            {
+                if (hostCount >= 10)
+                {
+                    break;
+                }
+                if (host.is<const char *>())
+                {
+                    hosts[hostCount++] = host.as<const char *>();
+                }
+            }
+
+            this->http->prewarm(hosts, hostCount); // result is printed by class
+            break;
+        }
+        case COMMAND_TYPE_GET_JSONPATH:
+        {
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            // Extract the JSON by removing the command part
+            String jsonData = _data.substring(strlen("[GET/JSONPATH]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->print(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            // Extract values from JSON
+            if (!doc["url"] || !doc["path"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain url or path."));
+                this->led.off();
+                return;
+            }
+            String url = doc["url"];
+
+            JsonPath path(this->uart);
+            if (!path.compile(doc["path"].as<const char *>()))
+            {
+                this->uart->println(F("[ERROR] Unsupported JSONPath."));
+                this->led.off();
+                return;
+            }
+
+            // Extract headers if available
+            const char *headerKeys[HTTP_MAX_HEADERS];
+            const char *headerValues[HTTP_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, HTTP_MAX_HEADERS);
+            if (headerSize < 0)
+            {
+                this->led.off();
+                return;
+            }
+
+            // GET request, matches are written as they are found
+            if (!this->http->streamJsonPath("GET", url, "", headerKeys, headerValues, headerSize, path))
+            {
+                this->uart->println(F("[ERROR] GET request failed or returned empty data."));
+            }
+            break;
+        }
+        case COMMAND_TYPE_PARSE_LOAD:
+        {
+            // Extract the JSON by removing the command part
+            String jsonData = _data.substring(strlen("[PARSE/LOAD]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->print(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            // Load either the given json or the last HTTP response
+            int handle = -1;
+            if (doc["last_response"] | false)
+            {
+                if (this->lastResponse == "")
+                {
+                    this->uart->println(F("[ERROR] No HTTP response to load."));
+                    this->led.off();
+                    return;
+                }
+                handle = this->parser->load(this->lastResponse);
+                this->lastResponse = String(); // the parsed copy replaces it
+            }
+            else if (doc["json"])
+            {
+                handle = this->parser->store(doc["json"].as<JsonVariantConst>());
+            }
+            else
+            {
+                this->uart->println(F("[ERROR] JSON does not contain json or last_response."));
+                this->led.off();
+                return;
+            }
+
+            if (handle == -1)
+            {
+                this->led.off();
+                return; // error is handled by class
+            }
+
+            char response[48];
+            snprintf(response, sizeof(response), "[PARSE/LOADED]{\"handle\":%d}", handle);
+            this->uart->println(response);
+            break;
+        }
+        case COMMAND_TYPE_PARSE_GET:
+        {
+            // Extract the JSON by removing the command part
+            String jsonData = _data.substring(strlen("[PARSE/GET]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->print(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            // Extract values from JSON
+            if (!doc["path"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain path."));
+                this->led.off();
+                return;
+            }
+
+            this->parser->get(doc["handle"] | -1, doc["path"].as<const char *>()); // error is handled by class
+            break;
+        }
+        case COMMAND_TYPE_PARSE_FREE:
+        {
+            // Extract the JSON by removing the command part
+            String jsonData = _data.substring(strlen("[PARSE/FREE]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->print(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            if (!this->parser->release(doc["handle"] | -1))
+            {
+                this->uart->println(F("[ERROR] Invalid parse handle."));
+                this->led.off();
+                return;
+            }
+            this->uart->println(F("[SUCCESS] Parsed document freed."));
+            break;
+        }
+        case COMMAND_TYPE_FILE_READ:
+        {
+#ifdef BOARD_BW16
+            this->uart->println(F("[ERROR] Downloading to flash is not supported on BW16."));
+#else
+            // Extract the JSON by removing the command part
+            String jsonData = _data.substring(strlen("[FILE/READ]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            if (jsonData.length() > 0 && deserializeJson(doc, jsonData))
+            {
+                this->uart->print(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            File file = this->storage.open(downloadFilePath, "r");
+            if (!file)
+            {
+                this->uart->println(F("[ERROR] No downloaded file on the device."));
+                this->led.off();
+                return;
+            }
+
+            // Reads are stateless, so an interrupted drain resumes by asking for the next offset again
+            size_t fileSize = file.size();
+            size_t offset = doc["offset"] | 0;
+            size_t length = doc["length"] | 0;
+            if (offset > fileSize)
+            {
+                offset = fileSize;
+            }
+            if (length == 0 || length > fileSize - offset)
+            {
+                length = fileSize - offset;
+            }
+            if (!file.seek(offset))
+            {
+                file.close();
+                this->uart->println(F("[ERROR] Failed to seek in the downloaded file."));
+                this->led.off();
+                return;
+            }
+
+            char headerResponse[128];
+            snprintf(headerResponse, sizeof(headerResponse), "[FILE/SUCCESS]{\"offset\":%lu,\"length\":%lu,\"size\":%lu}", (unsigned long)offset, (unsigned long)length, (unsigned long)fileSize);
+            this->uart->println(headerResponse);
+
+            uint8_t buf[MAX_CHUNK_SIZE];
+            size_t remaining = length;
+            while (remaining > 0)
+            {
+                size_t bytesRead = file.read(buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+                if (bytesRead == 0)
+                {
+                    break;
+                }
+                this->uart->write(buf, bytesRead);
+                remaining -= bytesRead;
+            }
+            file.close();
+
+            this->uart->flush();
+            this->uart->println();
+            this->uart->println(F("[FILE/END]"));
+#endif
+            break;
+        }
+        case COMMAND_TYPE_SSE_START:
+        {
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[SSE/START]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            if (!doc["url"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain url."));
+                this->led.off();
+                return;
+            }
+            String url = doc["url"].as<String>();
+
+            // Extract headers if available, the event source keeps its own copies
+            const char *headerKeys[SSE_MAX_HEADERS];
+            const char *headerValues[SSE_MAX_HEADERS];
+            int headerSize = this->collectHeaders(doc, headerKeys, headerValues, SSE_MAX_HEADERS);
+            if (headerSize < 0)
+            {
+                this->led.off();
+                return;
+            }
+
+            if (!this->sse)
+            {
+                this->sse = new EventSource(this->uart);
+            }
+
+            if (!this->sse)
+            {
+                this->uart->println(F("[ERROR] Failed to allocate EventSource object."));
+                this->led.off();
+                return;
+            }
+
+            if (!this->sse->begin(url.c_str(), headerKeys, headerValues, headerSize))
+            {
+                // Don't keep the event source (and its client) when there is no stream
+                delete this->sse;
+                this->sse = nullptr;
+                this->uart->println(F("[ERROR] Failed to open the event stream."));
+                this->led.off();
+                return;
+            }
+
+            // Events are forwarded from the main loop until the Flipper sends [SSE/STOP]
+            this->uart->println(F("[SSE/CONNECTED]"));
+            break;
+        }
+        case COMMAND_TYPE_SSE_STOP:
+            if (this->sse)
+            {
+                delete this->sse;
+                this->sse = nullptr;
+            }
+            this->uart->println(F("[SSE/STOPPED]"));
+            break;
+        case COMMAND_TYPE_MQTT_CONNECT:
+        {
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[MQTT/CONNECT]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            if (!doc["url"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain url."));
+                this->led.off();
+                return;
+            }
+
+            String url = doc["url"].as<String>();
+            String clientId = doc["client_id"] | "flipper-http";
+            const char *username = doc["username"] | (const char *)nullptr;
+            const char *password = doc["password"] | (const char *)nullptr;
+            uint16_t keepAlive = doc["keep_alive"] | 60;
+            bool cleanSession = doc["clean"] | true;
+
+            if (!this->mqtt)
+            {
+                this->mqtt = new MqttClient(this->uart);
+            }
+
+            if (!this->mqtt)
+            {
+                this->uart->println(F("[ERROR] Failed to allocate MQTT client."));
+                this->led.off();
+                return;
+            }
+
+            if (!this->mqtt->connect(url.c_str(), clientId.c_str(), username, password, keepAlive, cleanSession))
+            {
+                delete this->mqtt;
+                this->mqtt = nullptr;
+                this->uart->println(F("[ERROR] Failed to connect to the MQTT broker."));
+                this->led.off();
+                return;
+            }
+
+            this->uart->println(F("[MQTT/CONNECTED]"));
+            break;
+        }
+        case COMMAND_TYPE_MQTT_SUB:
+        {
+            if (!this->mqtt || !this->mqtt->connected())
+            {
+                this->uart->println(F("[ERROR] MQTT is not connected."));
+                this->led.off();
+                return;
+            }
+
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[MQTT/SUB]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            if (!doc["topic"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain topic."));
+                this->led.off();
+                return;
+            }
+
+            const char *topic = doc["topic"];
+            uint8_t qos = doc["qos"] | 0;
+            int granted = this->mqtt->subscribe(topic, qos > 1 ? 1 : qos);
+            if (granted < 0)
+            {
+                this->uart->println(F("[ERROR] Failed to subscribe to topic."));
+                this->led.off();
+                return;
+            }
+
+            JsonDocument response;
+            response["topic"] = topic;
+            response["qos"] = granted;
+            String output;
+            serializeJson(response, output);
+            this->uart->println("[MQTT/SUBSCRIBED]" + output);
+            break;
+        }
+        case COMMAND_TYPE_MQTT_PUB:
+        {
+            if (!this->mqtt)
+            {
+                this->uart->println(F("[ERROR] MQTT is not connected."));
+                this->led.off();
+                return;
+            }
+
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[MQTT/PUB]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            if (!doc["topic"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain topic."));
+                this->led.off();
+                return;
+            }
+
+            // Strings are sent as they are, any other JSON value is sent serialized
+            String payload;
+            if (doc["payload"].is<const char *>())
+            {
+                payload = doc["payload"].as<String>();
+            }
+            else if (!doc["payload"].isNull())
+            {
+                serializeJson(doc["payload"], payload);
+            }
+            uint8_t qos = doc["qos"] | 0;
+            bool retain = doc["retain"] | false;
+
+            // QoS 1 publishes are confirmed later with [MQTT/PUBACK]{"id":...}
+            int id = this->mqtt->publish(doc["topic"].as<const char *>(), (const uint8_t *)payload.c_str(), payload.length(), qos > 1 ? 1 : qos, retain);
+            if (id < 0)
+            {
+                this->uart->println(F("[ERROR] MQTT outbound queue is full."));
+                this->led.off();
+                return;
+            }
+            this->uart->println("[MQTT/QUEUED]{\"id\":" + String(id) + "}");
+            break;
+        }
+        case COMMAND_TYPE_MQTT_DISCONNECT:
+            if (this->mqtt)
+            {
+                delete this->mqtt;
+                this->mqtt = nullptr;
+            }
+            this->uart->println(F("[MQTT/DISCONNECTED]"));
+            break;
+        case COMMAND_TYPE_POLL_START:
+        {
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[POLL/START]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            if (!doc["url"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain url."));
+                this->led.off();
+                return;
+            }
+            String url = doc["url"];
+            uint32_t interval = doc["interval_ms"] | 5000;
+
+            // Extract headers if available
+            int headerSize = 0;
+            const char *headerKeys[10];
+            const char *headerValues[10];
+
+            if (doc["headers"])
+            {
+                JsonObject headers = doc["headers"];
+                for (JsonPair kv : headers)
+                {
+                    if (headerSize >= 10)
+                    {
+                        break;
+                    }
+                    headerKeys[headerSize] = kv.key().c_str();
+                    headerValues[headerSize] = kv.value().as<const char *>();
+                    headerSize++;
+                }
+            }
+
+            if (!this->poller)
+            {
+                this->poller = new Poller(this->uart);
+            }
+
+            if (!this->poller)
+            {
+                this->uart->println(F("[ERROR] Failed to allocate poller."));
+                this->led.off();
+                return;
+            }
+
+            int id = this->poller->start(url, interval, headerKeys, headerValues, headerSize);
+            if (id < 0)
+            {
+                // Don't keep a poller (and its client) that has nothing to poll, as [POLL/STOP] does
+                if (!this->poller->active())
+                {
+                    delete this->poller;
+                    this->poller = nullptr;
+                }
+                this->led.off();
+                return;
+            }
+            this->uart->println("[POLL/STARTED]{\"id\":" + String(id) + "}");
+            break;
+        }
+        case COMMAND_TYPE_POLL_STOP:
+        {
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[POLL/STOP]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            int id = doc["id"] | -1;
+            if (!this->poller || !this->poller->stop(id))
+            {
+                this->uart->println(F("[ERROR] Invalid poll id."));
+                this->led.off();
+                return;
+            }
+
+            // Free the poller's client once the last poll stops
+            if (!this->poller->active())
+            {
+                delete this->poller;
+                this->poller = nullptr;
+            }
+            this->uart->println("[POLL/STOPPED]{\"id\":" + String(id) + "}");
+            break;
+        }
+        case COMMAND_TYPE_UDP_BIND:
+        {
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[UDP/BIND]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            if (!doc["port"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain port."));
+                this->led.off();
+                return;
+            }
+            uint16_t port = doc["port"].as<uint16_t>();
+            bool binary = doc["binary"] | false;
+
+            if (!this->udp)
+            {
+                this->udp = new UdpSocket(this->uart);
+            }
+
+            if (!this->udp)
+            {
+                this->uart->println(F("[ERROR] Failed to allocate UDP socket."));
+                this->led.off();
+                return;
+            }
+
+            if (!this->udp->bind(port, binary))
+            {
+                delete this->udp;
+                this->udp = nullptr;
+                this->uart->println(F("[ERROR] Failed to bind UDP port."));
+                this->led.off();
+                return;
+            }
+            this->uart->println("[UDP/BOUND]{\"port\":" + String(port) + "}");
+            break;
+        }
+        case COMMAND_TYPE_UDP_SEND:
+        {
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[UDP/SEND]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            // With "length", that many raw bytes follow the command line instead of "data".
+            // They are always read, even when the command is refused, so none are taken for the next command
+            size_t length = doc["length"] | 0;
+            const char *data = doc["data"] | "";
+            if (length > UDP_MAX_PACKET || (length == 0 && strlen(data) > UDP_MAX_PACKET))
+            {
+                this->discardUartBytes(length);
+                this->uart->println(F("[ERROR] UDP packet is larger than 1472 bytes."));
+                this->led.off();
+                return;
+            }
+            uint8_t *packet = nullptr;
+            if (length > 0)
+            {
+                packet = (uint8_t *)malloc(length);
+                if (!packet)
+                {
+                    this->discardUartBytes(length);
+                    this->uart->println(F("[ERROR] Failed to allocate memory for UDP data."));
+                    this->led.off();
+                    return;
+                }
+                if (!this->readUartBytes(packet, length))
+                {
+                    free(packet);
+                    this->uart->println(F("[ERROR] Failed to receive UDP data."));
+                    this->led.off();
+                    return;
+                }
+            }
+
+            if (!this->udp || !this->udp->bound())
+            {
+                free(packet);
+                this->uart->println(F("[ERROR] UDP is not bound."));
+                this->led.off();
+                return;
+            }
+
+            if (!doc["host"] || !doc["port"])
+            {
+                free(packet);
+                this->uart->println(F("[ERROR] JSON does not contain host and port."));
+                this->led.off();
+                return;
+            }
+
+            // Successful sends are not acknowledged to keep the UART free for game traffic
+            const char *host = doc["host"];
+            uint16_t port = doc["port"].as<uint16_t>();
+            bool sent = packet ? this->udp->send(host, port, packet, length) : this->udp->send(host, port, (const uint8_t *)data, strlen(data));
+            free(packet);
+            if (!sent)
+            {
+                this->uart->println(F("[ERROR] Failed to send UDP packet."));
+                this->led.off();
+                return;
+            }
+            break;
+        }
+        case COMMAND_TYPE_UDP_CLOSE:
+            if (this->udp)
+            {
+                delete this->udp;
+                this->udp = nullptr;
+            }
+            this->uart->println(F("[UDP/CLOSED]"));
+            break;
+        case COMMAND_TYPE_TCP_START:
+        {
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[TCP/START]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            if (!doc["host"] || !doc["port"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain host and port."));
+                this->led.off();
+                return;
+            }
+            const char *host = doc["host"];
+            uint16_t port = doc["port"].as<uint16_t>();
+            bool tls = doc["tls"] | false;
+            const char *escape = doc["escape"] | TCP_DEFAULT_ESCAPE;
+            uint32_t idleFlush = doc["idle_ms"] | TCP_IDLE_FLUSH;
+
+            if (strlen(escape) > TCP_ESCAPE_SIZE)
+            {
+                this->uart->println(F("[ERROR] Escape sequence is too long."));
+                this->led.off();
+                return;
+            }
+
+            TcpTunnel *tunnel = new TcpTunnel(this->uart);
+            if (!tunnel)
+            {
+                this->uart->println(F("[ERROR] Failed to allocate TCP tunnel."));
+                this->led.off();
+                return;
+            }
+
+            bool opened = tunnel->open(host, port, tls ? &this->client : nullptr);
+#ifndef BOARD_BW16
+            if (!opened && tls)
+            {
+                // certification failed? connect without SSL
+                this->client.setInsecure();
+                opened = tunnel->open(host, port, &this->client);
+            }
+#endif
+            if (!opened)
+            {
+#ifndef BOARD_BW16
+                this->client.setCACert(root_ca);
+#endif
+                delete tunnel;
+                char headerResponse[128];
+                snprintf(headerResponse, sizeof(headerResponse), "[ERROR] Failed to connect to %s:%d", host, port);
+                this->uart->println(headerResponse);
+                this->led.off();
+                return;
+            }
+
+            // Raw bytes flow both ways until the escape sequence or the server closes
+            this->uart->println(F("[TCP/CONNECTED]"));
+            tunnel->run(escape, idleFlush);
+            delete tunnel;
+#ifndef BOARD_BW16
+            if (tls)
+            {
+                this->client.setCACert(root_ca);
+            }
+#endif
+            this->uart->println();
+            this->uart->println(F("[TCP/STOPPED]"));
+            break;
+        }
+        case COMMAND_TYPE_SOCKET_OPEN:
+        {
+            if (!this->wifi.isConnected() && !this->wifi.connect(loaded_ssid, loaded_pass))
+            {
+                this->uart->println(F("[ERROR] Not connected to Wifi. Failed to reconnect."));
+                this->led.off();
+                return;
+            }
+
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[SOCKET/OPEN]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            if (!doc["url"])
+            {
+                this->uart->println(F("[ERROR] JSON does not contain url."));
+                this->led.off();
+                return;
+            }
+            String url = doc["url"];
+            uint16_t port = doc["port"] | 0;
+            uint32_t pingInterval = doc["ping_interval"] | 20000;
+            uint32_t pongTimeout = doc["pong_timeout"] | 10000;
+            uint8_t deflateBits = (doc["deflate"] | false) ? (doc["window_bits"] | 10) : 0;
+            bool noContextTakeover = doc["no_context_takeover"] | false;
+
+            // Extract headers if available
+            int headerSize = 0;
+            const char *headerKeys[SOCKET_MAX_HEADERS];
+            const char *headerValues[SOCKET_MAX_HEADERS];
+
+            if (doc["headers"])
+            {
+                JsonObject headers = doc["headers"];
+                for (JsonPair kv : headers)
+                {
+                    if (headerSize >= SOCKET_MAX_HEADERS)
+                    {
+                        break;
+                    }
+                    headerKeys[headerSize] = kv.key().c_str();
+                    headerValues[headerSize] = kv.value().as<const char *>();
+                    headerSize++;
+                }
+            }
+
+            if (!this->sockets)
+            {
+                this->sockets = new SocketSessions(this->uart);
+            }
+
+            if (!this->sockets)
+            {
+                this->uart->println(F("[ERROR] Failed to allocate socket sessions."));
+                this->led.off();
+                return;
+            }
+
+            int id = this->sockets->open(url, port, headerKeys, headerValues, headerSize, pingInterval, pongTimeout, deflateBits, noContextTakeover);
+            if (id < 0)
+            {
+                this->led.off();
+                return;
+            }
+            this->sockets->get(id)->setCoalesce(doc["coalesce_ms"] | 0, doc["coalesce_bytes"] | WS_COALESCE_SIZE);
+            String opened = "[SOCKET/OPENED]{\"id\":" + String(id);
+            if (this->sockets->get(id)->compressing())
+            {
+                opened += ",\"deflate\":true";
+            }
+            this->uart->println(opened + "}");
+            break;
+        }
+        case COMMAND_TYPE_SOCKET_SEND:
+        {
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[SOCKET/SEND]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            // {"id":0,"message":"..."} sends text, {"id":0,"length":n} sends the n raw bytes that follow as binary
+            int id = doc["id"] | -1;
+            WebSocket *session = this->sockets ? this->sockets->get(id) : nullptr;
+            if (!doc["length"].isNull())
+            {
+                size_t length = doc["length"] | 0;
+                uint8_t buffer[MAX_CHUNK_SIZE];
+                if (session)
+                {
+                    session->flush(); // keep the order of queued text
+                }
+                size_t sent = 0;
+                do
+                {
+                    size_t piece = length - sent < sizeof(buffer) ? length - sent : sizeof(buffer);
+                    if (!this->readUartBytes(buffer, piece))
+                    {
+                        this->uart->println(F("[ERROR] Failed to receive binary message."));
+                        if (session)
+                        {
+                            this->sockets->close(id); // a half-sent message cannot be taken back
+                            this->uart->println("[SOCKET/CLOSED]{\"id\":" + String(id) + "}");
+                        }
+                        this->led.off();
+                        return;
+                    }
+                    sent += piece;
+                    if (session)
+                    {
+                        session->sendFragment(buffer, piece, true, sent == length);
+                    }
+                } while (sent < length);
+            }
+            else if (session)
+            {
+                String message = doc["message"] | "";
+                if (session->queueFull())
+                {
+                    session->flush();
+                }
+                session->queue(message);
+            }
+            if (!session)
+            {
+                this->uart->println(F("[ERROR] Invalid socket id."));
+                this->led.off();
+                return;
+            }
+            break;
+        }
+        case COMMAND_TYPE_SOCKET_CLOSE:
+        {
+            // Remove the command prefix to isolate the JSON payload
+            String jsonData = _data.substring(strlen("[SOCKET/CLOSE]"));
+            jsonData.trim();
+
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, jsonData);
+
+            if (error)
+            {
+                this->uart->println(F("[ERROR] Failed to parse JSON."));
+                this->led.off();
+                return;
+            }
+
+            int id = doc["id"] | -1;
+            if (!this->sockets || !this->sockets->close(id))
+            {
+                this->uart->println(F("[ERROR] Invalid socket id."));
+                this->led.off();
+                return;
+            }
+
+            // Free the sessions once the last one closes
+            if (!this->sockets->active())
+            {
+                delete this->sockets;
+                this->sockets = nullptr;
+            }
+            this->uart->println("[SOCKET/CLOSED]{\"id\":" + String(id) + "}");
+            break;
+        }
         default:
             break;
         }
@@ -3,7 +3,7 @@ Author: JBlanked
 Github: https://github.com/jblanked/FlipperHTTP
 Info: This library is a wrapper around the HTTPClient library and is used to communicate with the FlipperZero over serial.
 Created: 2024-09-30
-Updated: 2026-04-07
+Updated: 2026-10-19
 
 Change Log:
 - 2024-09-30: Initial commit
@@ -82,6 +82,49 @@ Change Log:
     - Replaced local WiFiClient instance with a class instance to fix WebSocket crash
     - Improved WebSocket error handling
     - Bumped version to 2.1.7
+- 2026-10-19:
+    - Added "offset", "length" and "resume" options to [GET/BYTES] for ranged and resumable downloads
+    - Added [RFILE/OPEN], [RFILE/READ] and [RFILE/CLOSE] commands for random access to remote files (rfile.hpp/cpp)
+    - Remote files share the HTTP core connection instead of a TLS client per handle, work on BW16, prefetch the next block from the main loop while the UART is idle, and report "size":-1 when the server answers Content-Range: bytes a-b/*
+    - Added [HTTP/PREWARM] command to resolve hosts and pre-open a TLS connection before the first request
+    - Kept-alive connections are now only reused for requests to the same host
+    - Added "filter" option to [GET/HTTP] and [POST/HTTP] to return only the requested JSON fields
+    - Added [GET/JSONPATH] command to extract values from responses of any size with a streaming JSONPath parser (json_path.hpp/cpp)
+    - Added [PARSE/LOAD], [PARSE/GET] and [PARSE/FREE] commands to keep parsed JSON on the device (parse_cache.hpp/cpp)
+    - [PARSE/LOAD]{"last_response":true} loads the response of the last [GET/HTTP], [POST/HTTP], [PUT/HTTP] or [DELETE/HTTP] sent with "retain":true; other requests free it instead of keeping up to 8 KB
+    - Added multipart/form-data ("fields", "filename", "field_name") and chunked uploads (when "size" is omitted) to [POST/FILE]
+    - [POST/FILE] sends number and boolean "fields" as their text instead of an empty part
+    - [POST/FILE] now coalesces the request head and body into 2 KB writes instead of one TLS record per UART read
+    - Added "spool" option to [POST/FILE] to receive the file into flash with a CRC-32 check first, then upload it with retries
+    - Added "to_device" option to [GET/BYTES] to download into flash at WiFi speed, and [FILE/READ] to drain it to the Flipper
+    - "to_device" downloads honour "offset"/"length" and are discarded with an [ERROR] when the body ends before its announced length
+    - Added a board-independent HTTP/1.1 client core (http_core.hpp/cpp) with request serialization, an incremental response parser, chunked decoding and keep-alive
+    - BW16 requests now go through the HTTP core, so responses are no longer cut off at the first segment
+    - Added [GET/BYTES], [POST/BYTES] and [POST/FILE] support for BW16 through the HTTP core, with ranges, resume and coalesced uploads
+    - [POST/FILE] now parses the response with the HTTP core's incremental parser instead of a String per header line, and decodes chunked responses
+    - Requests, byte streams, downloads, JSON filters and [GET/JSONPATH] on every board now go through the HTTP core instead of HTTPClient; a kept-alive connection idle for 10 s is reopened, and one the server closed while idle is retried once
+    - HTTP core requests size their headers to fit (no 1 KB limit), name non-default ports in the Host header, send Content-Type only with a body, accept host names up to 253 characters, are not sent twice when the server is slow, and refuse more than 10 headers with an [ERROR]
+    - [POST/FILE] builds its request with the HTTP core, so URLs with an explicit port work
+    - Added host tests for the HTTP core (tests/http_core, run with tools/test_http_core.sh)
+    - Added [SSE/START] and [SSE/STOP] commands to forward Server-Sent Events as they arrive, reconnecting with Last-Event-ID (sse.hpp/cpp)
+    - Server-Sent Events are forwarded from the main loop on their own client, so other commands keep working while a stream is open; events with more than 1 KB of data carry "truncated":true
+    - Added [MQTT/CONNECT], [MQTT/SUB], [MQTT/PUB] and [MQTT/DISCONNECT] commands for an MQTT 3.1.1 session with keep-alive, QoS 0/1 and an outbound queue (mqtt.hpp/cpp)
+    - A QoS 1 MQTT publish longer than 1024 bytes is forwarded with "truncated":true and left unacknowledged, so the broker doesn't count it as delivered; added host tests against a scripted broker (tests/mqtt, run with tools/test_mqtt.sh)
+    - Added [POLL/START] and [POLL/STOP] commands to poll URLs on the device and only forward responses that changed, by ETag or CRC-32 (poll.hpp/cpp)
+    - Poll requests are advanced from the main loop without waiting for the server, so commands are read while a poll is in flight, and a [POLL/START] that fails frees the poller
+    - Added [UDP/BIND], [UDP/SEND] and [UDP/CLOSE] commands with asynchronous [UDP/RECV] lines and optional binary framing (udp.hpp/cpp)
+    - [UDP/SEND] refuses packets over 1472 bytes and always reads the announced "length" bytes, and [UDP/RECV] marks longer datagrams "truncated":true
+    - The VGM relays bytes between the Flipper and the ESP32 unchanged and without waiting for a reply line, so [UDP/SEND], [SOCKET/BINARY] and [TCP/START] payloads and commands without a reply no longer stall or get reframed
+    - Added [TCP/START] command for a transparent TCP/TLS byte pipe that flushes on UART idle and ends on an escape sequence (tcp_tunnel.hpp/cpp)
+    - WebSocket frames are now handled by the firmware instead of ArduinoHttpClient, so [SOCKET/START] carries binary messages as [SOCKET/BINARY]{"length":n} plus raw bytes in both directions
+    - Fragmented WebSocket messages are reassembled before they are forwarded, and [SOCKET/BINARY] input is sent as continuation frames while it arrives
+    - [SOCKET/START] sleeps until the UART or the WebSocket has data, pings the server every ping_interval ms (default 20000, 0 disables), drops the session when a pong takes longer than pong_timeout ms and reports each round trip as [SOCKET/RTT]{"ms":n}
+    - [SOCKET/START] connects to wss:// URLs over TLS with the same certificates as HTTP requests
+    - WebSocket handshakes are refused unless Sec-WebSocket-Accept matches the key sent, wss:// tries certificate verification again on every connect, and frames with a reserved opcode close the connection with code 1002
+    - Added [SOCKET/OPEN], [SOCKET/SEND] and [SOCKET/CLOSE] for up to four WebSockets that stay open in the background, with inbound messages forwarded as [SOCKET/MESSAGE]{"id":n,"length":n} (socket_sessions.hpp/cpp)
+    - [SOCKET/START] and [SOCKET/OPEN] accept "deflate":true to negotiate permessage-deflate, with "window_bits" (9-15, default 10) and "no_context_takeover" to bound its memory (deflate.hpp/cpp)
+    - [SOCKET/START] and [SOCKET/OPEN] accept "coalesce_ms" to hold text lines for up to that long and write their frames together, sent early once "coalesce_bytes" are waiting
+    - Bumped version to 2.1.8
 
 */
 #pragma once
@@ -90,6 +133,14 @@ Change Log:
 #include "uart.hpp"
 #include "http.hpp"
 #include "websocket.hpp"
+#include "rfile.hpp"
+#include "parse_cache.hpp"
+#include "sse.hpp"
+#include "mqtt.hpp"
+#include "poll.hpp"
+#include "udp.hpp"
+#include "tcp_tunnel.hpp"
+#include "socket_sessions.hpp"
 #include "storage.hpp"
 #include "wifi_utils.hpp"
 #include <ArduinoJson.h>
@@ -98,7 +149,7 @@ Change Log:
 #include <string.h>
 
 #define BAUD_RATE 115200
-#define FLIPPER_HTTP_VERSION "2.1.7"
+#define FLIPPER_HTTP_VERSION "2.1.8"
 
 class FlipperHTTP
 {
@@ -113,6 +164,16 @@ public:
     void setup();               // Arduino setup function
     void loop();                // Main loop for flipper-http.ino that handles all of the commands
 private:
+    void retainResponse(const String &response, bool retain); // Keep the last HTTP response for [PARSE/LOAD] if asked to, else free it
+    bool readUartBytes(uint8_t *buffer, size_t size);         // Read raw bytes that follow a command line
+    bool discardUartBytes(size_t size);                       // Read and drop raw bytes that follow a refused command line
+    int collectHeaders(JsonDocument &doc, const char *keys[], const char *values[], int maxHeaders); // Collect the command's headers, -1 after an [ERROR] if there are too many
+#ifndef BOARD_BW16
+    bool spoolUpload(size_t size, uint32_t &crc); // Receive size bytes from UART into the spool file, returns their CRC-32
+#endif
+#ifdef BOARD_VGM
+    void relayBytes(UART *from, UART *to); // Pass the bytes waiting on one UART to the other
+#endif
     char loaded_ssid[64] = {0}; // Variable to store SSID
     char loaded_pass[64] = {0}; // Variable to store password
     bool use_led = true;        // Variable to control LED usage
@@ -129,11 +190,21 @@ private:
 #else
     UART *uart; // UART object to handle serial communication
 #endif
-    WiFiUtils wifi;         // WiFiUtils object to handle WiFi connections
-    StorageManager storage; // StorageManager object to handle storage operations
-    HTTP *http;             // HTTP object to handle HTTP requests
-    WebSocket *websocket;   // WebSocket object to handle WebSocket connections
+    WiFiUtils wifi;                        // WiFiUtils object to handle WiFi connections
+    StorageManager storage;                // StorageManager object to handle storage operations
+    HTTP *http;                            // HTTP object to handle HTTP requests
+    WebSocket *websocket;                  // WebSocket object to handle WebSocket connections
+    RemoteFile *rfiles[RFILE_MAX_HANDLES]; // Open remote files, indexed by handle
+    ParseCache *parser;                    // Parsed JSON documents kept for [PARSE/GET]
+    EventSource *sse;                      // Server-Sent Events stream for [SSE/START]
+    MqttClient *mqtt;                      // MQTT session kept open between commands
+    Poller *poller;                        // Device-side polls started with [POLL/START]
+    UdpSocket *udp;                        // UDP socket bound with [UDP/BIND]
+    SocketSessions *sockets;               // WebSockets opened with [SOCKET/OPEN]
+    String lastResponse;                   // Last HTTP response body, if its request asked for "retain":true and it was small enough to keep
 };
 
 const PROGMEM char settingsFilePath[] = "/flipper-http.json"; // Path to the settings file in the SPIFFS file system
 const PROGMEM char ledStateFilePath[] = "/led.txt";           // Path to the LED state file in the SPIFFS file system
+const PROGMEM char uploadSpoolFilePath[] = "/upload.bin";     // Path to the spooled [POST/FILE] upload in the SPIFFS file system
+const PROGMEM char downloadFilePath[] = "/download.bin";      // Path to the [GET/BYTES] to_device download in the SPIFFS file system
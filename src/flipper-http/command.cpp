@@ -66,6 +66,54 @@ String commandToString(CommandType command)
         return "[SOCKET/START]";
     case COMMAND_TYPE_SOCKET_STOP:
         return "[SOCKET/STOP]";
+    case COMMAND_TYPE_RFILE_OPEN:
+        return "[RFILE/OPEN]";
+    case COMMAND_TYPE_RFILE_READ:
+        return "[RFILE/READ]";
+    case COMMAND_TYPE_RFILE_CLOSE:
+        return "[RFILE/CLOSE]";
+    case COMMAND_TYPE_HTTP_PREWARM:
+        return "[HTTP/PREWARM]";
+    case COMMAND_TYPE_GET_JSONPATH:
+        return "[GET/JSONPATH]";
+    case COMMAND_TYPE_PARSE_LOAD:
+        return "[PARSE/LOAD]";
+    case COMMAND_TYPE_PARSE_GET:
+        return "[PARSE/GET]";
+    case COMMAND_TYPE_PARSE_FREE:
+        return "[PARSE/FREE]";
+    case COMMAND_TYPE_FILE_READ:
+        return "[FILE/READ]";
+    case COMMAND_TYPE_SSE_START:
+        return "[SSE/START]";
+    case COMMAND_TYPE_SSE_STOP:
+        return "[SSE/STOP]";
+    case COMMAND_TYPE_MQTT_CONNECT:
+        return "[MQTT/CONNECT]";
+    case COMMAND_TYPE_MQTT_SUB:
+        return "[MQTT/SUB]";
+    case COMMAND_TYPE_MQTT_PUB:
+        return "[MQTT/PUB]";
+    case COMMAND_TYPE_MQTT_DISCONNECT:
+        return "[MQTT/DISCONNECT]";
+    case COMMAND_TYPE_POLL_START:
+        return "[POLL/START]";
+    case COMMAND_TYPE_POLL_STOP:
+        return "[POLL/STOP]";
+    case COMMAND_TYPE_UDP_BIND:
+        return "[UDP/BIND]";
+    case COMMAND_TYPE_UDP_SEND:
+        return "[UDP/SEND]";
+    case COMMAND_TYPE_UDP_CLOSE:
+        return "[UDP/CLOSE]";
+    case COMMAND_TYPE_TCP_START:
+        return "[TCP/START]";
+    case COMMAND_TYPE_SOCKET_OPEN:
+        return "[SOCKET/OPEN]";
+    case COMMAND_TYPE_SOCKET_SEND:
+        return "[SOCKET/SEND]";
+    case COMMAND_TYPE_SOCKET_CLOSE:
+        return "[SOCKET/CLOSE]";
     default:
         return "[UNKNOWN]";
     };
@@ -201,6 +249,102 @@ CommandType commandFromString(const String &string)
     {
         return COMMAND_TYPE_SOCKET_STOP;
     }
+    if (string.startsWith("[RFILE/OPEN]"))
+    {
+        return COMMAND_TYPE_RFILE_OPEN;
+    }
+    if (string.startsWith("[RFILE/READ]"))
+    {
+        return COMMAND_TYPE_RFILE_READ;
+    }
+    if (string.startsWith("[RFILE/CLOSE]"))
+    {
+        return COMMAND_TYPE_RFILE_CLOSE;
+    }
+    if (string.startsWith("[HTTP/PREWARM]"))
+    {
+        return COMMAND_TYPE_HTTP_PREWARM;
+    }
+    if (string.startsWith("[GET/JSONPATH]"))
+    {
+        return COMMAND_TYPE_GET_JSONPATH;
+    }
+    if (string.startsWith("[PARSE/LOAD]"))
+    {
+        return COMMAND_TYPE_PARSE_LOAD;
+    }
+    if (string.startsWith("[PARSE/GET]"))
+    {
+        return COMMAND_TYPE_PARSE_GET;
+    }
+    if (string.startsWith("[PARSE/FREE]"))
+    {
+        return COMMAND_TYPE_PARSE_FREE;
+    }
+    if (string.startsWith("[FILE/READ]"))
+    {
+        return COMMAND_TYPE_FILE_READ;
+    }
+    if (string.startsWith("[SSE/START]"))
+    {
+        return COMMAND_TYPE_SSE_START;
+    }
+    if (string.startsWith("[SSE/STOP]"))
+    {
+        return COMMAND_TYPE_SSE_STOP;
+    }
+    if (string.startsWith("[MQTT/CONNECT]"))
+    {
+        return COMMAND_TYPE_MQTT_CONNECT;
+    }
+    if (string.startsWith("[MQTT/SUB]"))
+    {
+        return COMMAND_TYPE_MQTT_SUB;
+    }
+    if (string.startsWith("[MQTT/PUB]"))
+    {
+        return COMMAND_TYPE_MQTT_PUB;
+    }
+    if (string.startsWith("[MQTT/DISCONNECT]"))
+    {
+        return COMMAND_TYPE_MQTT_DISCONNECT;
+    }
+    if (string.startsWith("[POLL/START]"))
+    {
+        return COMMAND_TYPE_POLL_START;
+    }
+    if (string.startsWith("[POLL/STOP]"))
+    {
+        return COMMAND_TYPE_POLL_STOP;
+    }
+    if (string.startsWith("[UDP/BIND]"))
+    {
+        return COMMAND_TYPE_UDP_BIND;
+    }
+    if (string.startsWith("[UDP/SEND]"))
+    {
+        return COMMAND_TYPE_UDP_SEND;
+    }
+    if (string.startsWith("[UDP/CLOSE]"))
+    {
+        return COMMAND_TYPE_UDP_CLOSE;
+    }
+    if (string.startsWith("[TCP/START]"))
+    {
+        return COMMAND_TYPE_TCP_START;
+    }
+    if (string.startsWith("[SOCKET/OPEN]"))
+    {
+        return COMMAND_TYPE_SOCKET_OPEN;
+    }
+    if (string.startsWith("[SOCKET/SEND]"))
+    {
+        return COMMAND_TYPE_SOCKET_SEND;
+    }
+    if (string.startsWith("[SOCKET/CLOSE]"))
+    {
+        return COMMAND_TYPE_SOCKET_CLOSE;
+    }
 
     return COMMAND_TYPE_UNKNOWN;
 }
\ No newline at end of file
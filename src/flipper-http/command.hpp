@@ -35,6 +35,30 @@ typedef enum
     COMMAND_TYPE_BOARD_NAME,      // [BOARD/NAME]
     COMMAND_TYPE_SOCKET_START,    // [SOCKET/START]
     COMMAND_TYPE_SOCKET_STOP,     // [SOCKET/STOP]
+    COMMAND_TYPE_RFILE_OPEN,      // [RFILE/OPEN]
+    COMMAND_TYPE_RFILE_READ,      // [RFILE/READ]
+    COMMAND_TYPE_RFILE_CLOSE,     // [RFILE/CLOSE]
+    COMMAND_TYPE_HTTP_PREWARM,    // [HTTP/PREWARM]
+    COMMAND_TYPE_GET_JSONPATH,    // [GET/JSONPATH]
+    COMMAND_TYPE_PARSE_LOAD,      // [PARSE/LOAD]
+    COMMAND_TYPE_PARSE_GET,       // [PARSE/GET]
+    COMMAND_TYPE_PARSE_FREE,      // [PARSE/FREE]
+    COMMAND_TYPE_FILE_READ,       // [FILE/READ]
+    COMMAND_TYPE_SSE_START,       // [SSE/START]
+    COMMAND_TYPE_SSE_STOP,        // [SSE/STOP]
+    COMMAND_TYPE_MQTT_CONNECT,    // [MQTT/CONNECT]
+    COMMAND_TYPE_MQTT_SUB,        // [MQTT/SUB]
+    COMMAND_TYPE_MQTT_PUB,        // [MQTT/PUB]
+    COMMAND_TYPE_MQTT_DISCONNECT, // [MQTT/DISCONNECT]
+    COMMAND_TYPE_POLL_START,      // [POLL/START]
+    COMMAND_TYPE_POLL_STOP,       // [POLL/STOP]
+    COMMAND_TYPE_UDP_BIND,        // [UDP/BIND]
+    COMMAND_TYPE_UDP_SEND,        // [UDP/SEND]
+    COMMAND_TYPE_UDP_CLOSE,       // [UDP/CLOSE]
+    COMMAND_TYPE_TCP_START,       // [TCP/START]
+    COMMAND_TYPE_SOCKET_OPEN,     // [SOCKET/OPEN]
+    COMMAND_TYPE_SOCKET_SEND,     // [SOCKET/SEND]
+    COMMAND_TYPE_SOCKET_CLOSE,    // [SOCKET/CLOSE]
 } CommandType;
 
 String commandToString(CommandType command);
@@ -3,4 +3,5 @@
 
 const char *commonGetBoardName();
 size_t commonGetFreeHeap();
-void commonReboot();
\ No newline at end of file
+void commonReboot();
+uint32_t commonCrc32(const uint8_t *data, size_t size, uint32_t crc = 0); // CRC-32 (IEEE), pass the previous result to continue
\ No newline at end of file
@@ -0,0 +1,595 @@
+#include "deflate.hpp"
+
+// Base values and extra bits of the length (257..285) and distance (0..29) symbols
+static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Sync flush marker removed by the sender (RFC 7692 section 7.2.1)
+static const uint8_t flushTail[4] = {0x00, 0x00, 0xFF, 0xFF};
+
+static uint8_t clampWindowBits(uint8_t windowBits)
+{
+    if (windowBits < DEFLATE_MIN_WINDOW_BITS)
+        return DEFLATE_MIN_WINDOW_BITS;
+    if (windowBits > DEFLATE_MAX_WINDOW_BITS)
+        return DEFLATE_MAX_WINDOW_BITS;
+    return windowBits;
+}
+
+// Keeps the last size bytes of history followed by data
+static void keepHistory(uint8_t *history, size_t size, size_t &historyLength, const uint8_t *data, size_t length)
+{
+    if (length >= size)
+    {
+        memcpy(history, data + length - size, size);
+        historyLength = size;
+        return;
+    }
+    size_t keep = historyLength + length > size ? size - length : historyLength;
+    memmove(history, history + historyLength - keep, keep);
+    memcpy(history + keep, data, length);
+    historyLength = keep + length;
+}
+
+Inflater::Inflater(uint8_t windowBits, bool contextTakeover)
+{
+    this->historySize = contextTakeover ? (size_t)1 << clampWindowBits(windowBits) : 0;
+    this->history = contextTakeover ? (uint8_t *)malloc(this->historySize) : nullptr;
+    this->historyLength = 0;
+}
+
+Inflater::~Inflater()
+{
+    free(this->history);
+}
+
+bool Inflater::ready() const
+{
+    return this->historySize == 0 || this->history != nullptr;
+}
+
+int Inflater::bits(int need)
+{
+    while (this->bitCount < need)
+    {
+        uint8_t byte;
+        if (this->inputPosition < this->inputLength)
+        {
+            byte = this->input[this->inputPosition];
+        }
+        else if (this->inputPosition < this->inputLength + sizeof(flushTail))
+        {
+            byte = flushTail[this->inputPosition - this->inputLength];
+        }
+        else
+        {
+            return -1;
+        }
+        this->inputPosition++;
+        this->bitBuffer |= (uint32_t)byte << this->bitCount;
+        this->bitCount += 8;
+    }
+    int value = this->bitBuffer & ((1UL << need) - 1);
+    this->bitBuffer >>= need;
+    this->bitCount -= need;
+    return value;
+}
+
+int Inflater::decode(const Huffman &huffman)
+{
+    // Canonical codes of each length are consecutive, so walk the lengths one bit at a time
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int length = 1; length < 16; length++)
+    {
+        int bit = this->bits(1);
+        if (bit < 0)
+        {
+            return -1;
+        }
+        code |= bit;
+        int count = huffman.count[length];
+        if (code - count < first)
+        {
+            return huffman.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+int Inflater::build(Huffman &huffman, const uint16_t *lengths, int n)
+{
+    for (int length = 0; length < 16; length++)
+    {
+        huffman.count[length] = 0;
+    }
+    for (int symbol = 0; symbol < n; symbol++)
+    {
+        huffman.count[lengths[symbol]]++;
+    }
+    int left = 1;
+    for (int length = 1; length < 16; length++)
+    {
+        left <<= 1;
+        left -= huffman.count[length];
+        if (left < 0)
+        {
+            return -1;
+        }
+    }
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for (int length = 1; length < 15; length++)
+    {
+        offsets[length + 1] = offsets[length] + huffman.count[length];
+    }
+    for (int symbol = 0; symbol < n; symbol++)
+    {
+        if (lengths[symbol] != 0)
+        {
+            huffman.symbol[offsets[lengths[symbol]]++] = symbol;
+        }
+    }
+    return left;
+}
+
+bool Inflater::put(uint8_t byte)
+{
+    if (this->outputLength == this->outputMax)
+    {
+        this->tooBig = true;
+        return false;
+    }
+    if (this->outputLength == this->outputCapacity)
+    {
+        size_t capacity = this->outputCapacity * 2;
+        if (capacity > this->outputMax)
+        {
+            capacity = this->outputMax;
+        }
+        uint8_t *grown = (uint8_t *)realloc(this->output, capacity);
+        if (!grown)
+        {
+            return false;
+        }
+        this->output = grown;
+        this->outputCapacity = capacity;
+    }
+    this->output[this->outputLength++] = byte;
+    return true;
+}
+
+int Inflater::stored()
+{
+    // Stored blocks start on a byte boundary
+    this->bitBuffer = 0;
+    this->bitCount = 0;
+    int low = this->bits(8);
+    int high = this->bits(8);
+    int lowComplement = this->bits(8);
+    int highComplement = this->bits(8);
+    if (highComplement < 0)
+    {
+        return -1;
+    }
+    unsigned length = low | (high << 8);
+    if (length != (~(lowComplement | (highComplement << 8)) & 0xFFFF))
+    {
+        return -1;
+    }
+    while (length-- > 0)
+    {
+        int byte = this->bits(8);
+        if (byte < 0 || !this->put(byte))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int Inflater::codes()
+{
+    while (true)
+    {
+        int symbol = this->decode(this->lencode);
+        if (symbol < 0)
+        {
+            return -1;
+        }
+        if (symbol < 256)
+        {
+            if (!this->put(symbol))
+            {
+                return -1;
+            }
+            continue;
+        }
+        if (symbol == 256)
+        {
+            return 0; // end of block
+        }
+
+        symbol -= 257;
+        if (symbol >= 29)
+        {
+            return -1;
+        }
+        int extra = this->bits(lengthExtra[symbol]);
+        if (extra < 0)
+        {
+            return -1;
+        }
+        size_t length = lengthBase[symbol] + extra;
+
+        symbol = this->decode(this->distcode);
+        if (symbol < 0 || symbol >= 30)
+        {
+            return -1;
+        }
+        extra = this->bits(distanceExtra[symbol]);
+        if (extra < 0)
+        {
+            return -1;
+        }
+        size_t distance = distanceBase[symbol] + extra;
+        if (distance > this->outputLength + this->historyLength)
+        {
+            return -1;
+        }
+
+        // Copies may reach back into earlier messages and may overlap themselves
+        while (length-- > 0)
+        {
+            uint8_t byte = distance <= this->outputLength
+                               ? this->output[this->outputLength - distance]
+                               : this->history[this->historyLength - (distance - this->outputLength)];
+            if (!this->put(byte))
+            {
+                return -1;
+            }
+        }
+    }
+}
+
+int Inflater::fixed()
+{
+    uint16_t lengths[288];
+    int symbol = 0;
+    for (; symbol < 144; symbol++)
+        lengths[symbol] = 8;
+    for (; symbol < 256; symbol++)
+        lengths[symbol] = 9;
+    for (; symbol < 280; symbol++)
+        lengths[symbol] = 7;
+    for (; symbol < 288; symbol++)
+        lengths[symbol] = 8;
+    build(this->lencode, lengths, 288);
+    for (symbol = 0; symbol < 30; symbol++)
+        lengths[symbol] = 5;
+    build(this->distcode, lengths, 30);
+    return this->codes();
+}
+
+int Inflater::dynamic()
+{
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    uint16_t lengths[320];
+
+    int literalBits = this->bits(5);
+    int distanceBits = this->bits(5);
+    int codeBits = this->bits(4);
+    if (literalBits < 0 || distanceBits < 0 || codeBits < 0)
+    {
+        return -1;
+    }
+    int literalCount = literalBits + 257;
+    int distanceCount = distanceBits + 1;
+    int codeCount = codeBits + 4;
+    if (literalCount > 286 || distanceCount > 30)
+    {
+        return -1;
+    }
+
+    // Code lengths of the code length code
+    int index = 0;
+    for (; index < codeCount; index++)
+    {
+        int length = this->bits(3);
+        if (length < 0)
+        {
+            return -1;
+        }
+        lengths[order[index]] = length;
+    }
+    for (; index < 19; index++)
+    {
+        lengths[order[index]] = 0;
+    }
+    if (build(this->lencode, lengths, 19) != 0)
+    {
+        return -1; // must be complete
+    }
+
+    // Code lengths of the literal/length and distance codes
+    index = 0;
+    while (index < literalCount + distanceCount)
+    {
+        int symbol = this->decode(this->lencode);
+        if (symbol < 0)
+        {
+            return -1;
+        }
+        if (symbol < 16)
+        {
+            lengths[index++] = symbol;
+            continue;
+        }
+        uint16_t length = 0;
+        int repeat;
+        if (symbol == 16)
+        {
+            if (index == 0)
+            {
+                return -1;
+            }
+            length = lengths[index - 1];
+            repeat = this->bits(2);
+            repeat = repeat < 0 ? -1 : repeat + 3;
+        }
+        else if (symbol == 17)
+        {
+            repeat = this->bits(3);
+            repeat = repeat < 0 ? -1 : repeat + 3;
+        }
+        else
+        {
+            repeat = this->bits(7);
+            repeat = repeat < 0 ? -1 : repeat + 11;
+        }
+        if (repeat < 0 || index + repeat > literalCount + distanceCount)
+        {
+            return -1;
+        }
+        while (repeat-- > 0)
+        {
+            lengths[index++] = length;
+        }
+    }
+    if (lengths[256] == 0)
+    {
+        return -1; // no end of block code
+    }
+
+    // Incomplete codes are only allowed when a single code is used
+    int left = build(this->lencode, lengths, literalCount);
+    if (left < 0 || (left > 0 && literalCount - this->lencode.count[0] != 1))
+    {
+        return -1;
+    }
+    left = build(this->distcode, lengths + literalCount, distanceCount);
+    if (left < 0 || (left > 0 && distanceCount - this->distcode.count[0] != 1))
+    {
+        return -1;
+    }
+    return this->codes();
+}
+
+int Inflater::inflate(const uint8_t *data, size_t length, uint8_t *&output, size_t maxLength)
+{
+    this->input = data;
+    this->inputLength = length;
+    this->inputPosition = 0;
+    this->bitBuffer = 0;
+    this->bitCount = 0;
+    this->outputCapacity = length * 2 + 16 < maxLength ? length * 2 + 16 : maxLength;
+    this->output = (uint8_t *)malloc(this->outputCapacity + 1);
+    this->outputLength = 0;
+    this->outputMax = maxLength;
+    this->tooBig = false;
+    if (!this->output)
+    {
+        return -1;
+    }
+
+    // Blocks follow each other until the flush marker's empty stored block used up the input
+    int result = 0;
+    bool last = false;
+    while (!last && result == 0 && this->inputPosition < this->inputLength + sizeof(flushTail))
+    {
+        last = this->bits(1) == 1;
+        int type = this->bits(2);
+        if (type == 0)
+            result = this->stored();
+        else if (type == 1)
+            result = this->fixed();
+        else if (type == 2)
+            result = this->dynamic();
+        else
+            result = -1;
+    }
+    if (result != 0)
+    {
+        free(this->output);
+        this->output = nullptr;
+        return this->tooBig ? -2 : -1;
+    }
+
+    if (this->history)
+    {
+        keepHistory(this->history, this->historySize, this->historyLength, this->output, this->outputLength);
+    }
+    output = this->output;
+    this->output = nullptr;
+    return (int)this->outputLength;
+}
+
+Deflater::Deflater(uint8_t windowBits, bool contextTakeover)
+{
+    this->windowBits = clampWindowBits(windowBits);
+    this->historySize = contextTakeover ? (size_t)1 << this->windowBits : 0;
+    this->history = contextTakeover ? (uint8_t *)malloc(this->historySize) : nullptr;
+    this->historyLength = 0;
+    this->head = (uint16_t *)malloc(sizeof(uint16_t) << DEFLATE_HASH_BITS);
+}
+
+Deflater::~Deflater()
+{
+    free(this->history);
+    free(this->head);
+}
+
+bool Deflater::ready() const
+{
+    return this->head && (this->historySize == 0 || this->history);
+}
+
+size_t Deflater::bound(size_t length)
+{
+    // Fixed codes take at most 9 bits per literal, plus the block headers and end of block code
+    return length + length / 8 + 8;
+}
+
+uint8_t Deflater::at(size_t position) const
+{
+    return position < this->historyLength ? this->history[position] : this->message[position - this->historyLength];
+}
+
+uint32_t Deflater::hash(size_t position) const
+{
+    uint32_t key = ((uint32_t)this->at(position) << 16) | ((uint32_t)this->at(position + 1) << 8) | this->at(position + 2);
+    return (uint32_t)(key * 2654435761UL) >> (32 - DEFLATE_HASH_BITS);
+}
+
+void Deflater::putBits(uint32_t value, int count)
+{
+    this->bitBuffer |= value << this->bitCount;
+    this->bitCount += count;
+    while (this->bitCount >= 8)
+    {
+        this->out[this->outLength++] = this->bitBuffer & 0xFF;
+        this->bitBuffer >>= 8;
+        this->bitCount -= 8;
+    }
+}
+
+void Deflater::putCode(uint16_t code, int length)
+{
+    uint16_t reversed = 0;
+    for (int i = 0; i < length; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    this->putBits(reversed, length);
+}
+
+void Deflater::putLiteral(int symbol)
+{
+    if (symbol < 144)
+        this->putCode(0x30 + symbol, 8);
+    else if (symbol < 256)
+        this->putCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        this->putCode(symbol - 256, 7);
+    else
+        this->putCode(0xC0 + symbol - 280, 8);
+}
+
+size_t Deflater::deflate(const uint8_t *data, size_t length, uint8_t *output)
+{
+    size_t total = this->historyLength + length;
+    if (total > 0xFFFF)
+    {
+        return 0; // positions must fit the hash table entries
+    }
+    this->message = data;
+    this->out = output;
+    this->outLength = 0;
+    this->bitBuffer = 0;
+    this->bitCount = 0;
+    memset(this->head, 0, sizeof(uint16_t) << DEFLATE_HASH_BITS);
+    for (size_t position = 0; position + 2 < this->historyLength; position++)
+    {
+        this->head[this->hash(position)] = position + 1;
+    }
+
+    // One block with the fixed codes: small messages don't repay sending code tables
+    this->putBits(0, 1); // BFINAL
+    this->putBits(1, 2); // BTYPE fixed
+    size_t window = (size_t)1 << this->windowBits;
+    size_t position = this->historyLength;
+    while (position < total)
+    {
+        size_t matchLength = 0;
+        size_t distance = 0;
+        if (position + 2 < total)
+        {
+            uint32_t key = this->hash(position);
+            size_t candidate = this->head[key];
+            this->head[key] = position + 1;
+            if (candidate > 0 && position - (candidate - 1) <= window)
+            {
+                candidate--;
+                size_t limit = total - position < 258 ? total - position : 258;
+                while (matchLength < limit && this->at(candidate + matchLength) == this->at(position + matchLength))
+                {
+                    matchLength++;
+                }
+                distance = position - candidate;
+            }
+        }
+        if (matchLength < 3)
+        {
+            this->putLiteral(this->at(position));
+            position++;
+            continue;
+        }
+
+        int symbol = 28;
+        while (lengthBase[symbol] > matchLength)
+        {
+            symbol--;
+        }
+        this->putLiteral(257 + symbol);
+        this->putBits(matchLength - lengthBase[symbol], lengthExtra[symbol]);
+        symbol = 29;
+        while (distanceBase[symbol] > distance)
+        {
+            symbol--;
+        }
+        this->putCode(symbol, 5);
+        this->putBits(distance - distanceBase[symbol], distanceExtra[symbol]);
+
+        // Remember the skipped positions so later matches can start inside this one
+        for (size_t skipped = position + 1; skipped < position + matchLength && skipped + 2 < total; skipped++)
+        {
+            this->head[this->hash(skipped)] = skipped + 1;
+        }
+        position += matchLength;
+    }
+    this->putLiteral(256); // end of block
+
+    // The empty stored block of the sync flush, its 00 00 FF FF is left off
+    this->putBits(0, 3);
+    if (this->bitCount > 0)
+    {
+        this->putBits(0, 8 - this->bitCount);
+    }
+    if (this->outLength >= length)
+    {
+        return 0;
+    }
+
+    if (this->history)
+    {
+        keepHistory(this->history, this->historySize, this->historyLength, data, length);
+    }
+    return this->outLength;
+}
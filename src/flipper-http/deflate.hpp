@@ -0,0 +1,93 @@
+#pragma once
+#include <Arduino.h>
+
+#define DEFLATE_HASH_BITS 9        // Hash table of 2^9 entries for finding repeated strings
+#define DEFLATE_MIN_WINDOW_BITS 9  // Smallest window zlib accepts for permessage-deflate
+#define DEFLATE_MAX_WINDOW_BITS 15 // Largest window DEFLATE allows
+
+// Raw DEFLATE (RFC 1951) sized for permessage-deflate (RFC 7692) on small boards.
+// Each call handles one whole message. The sync flush marker 00 00 FF FF is left
+// off the compressed data and added back before inflating, as RFC 7692 asks.
+// With context takeover the last 2^windowBits bytes are kept so later messages
+// can refer back to earlier ones, otherwise nothing is kept between messages.
+
+class Inflater
+{
+public:
+    Inflater(uint8_t windowBits, bool contextTakeover);
+    ~Inflater();
+
+    bool ready() const; // Whether the history window could be allocated
+
+    // Decompresses one message into a buffer allocated with malloc (the caller frees it).
+    // Returns the decompressed length, -1 on corrupt data or -2 when it would exceed maxLength
+    int inflate(const uint8_t *data, size_t length, uint8_t *&output, size_t maxLength);
+
+private:
+    struct Huffman
+    {
+        uint16_t count[16];   // Number of codes of each length
+        uint16_t symbol[288]; // Symbols ordered by code
+    };
+
+    int bits(int need);                                                 // Reads need bits, -1 when the input ran out
+    int decode(const Huffman &huffman);                                 // Reads one Huffman coded symbol, -1 on error
+    static int build(Huffman &huffman, const uint16_t *lengths, int n); // Builds a canonical code, returns -1 if over-subscribed
+    int stored();                                                       // Copies a stored block
+    int codes();                                                        // Decodes a Huffman block with lencode/distcode
+    int fixed();                                                        // Decodes a block with the fixed codes
+    int dynamic();                                                      // Decodes a block with codes sent in the block
+    bool put(uint8_t byte);                                             // Appends one output byte
+
+    uint8_t *history;     // Last bytes of earlier messages, nullptr without context takeover
+    size_t historySize;   // Capacity of history
+    size_t historyLength; // Bytes in history
+
+    const uint8_t *input;  // Compressed message
+    size_t inputLength;    // Bytes in input, without the 4 flush bytes
+    size_t inputPosition;  // Next byte to read, may run 4 past inputLength
+    uint32_t bitBuffer;    // Bits read but not used yet
+    int bitCount;          // Number of bits in bitBuffer
+    uint8_t *output;       // Decompressed message
+    size_t outputLength;   // Bytes in output
+    size_t outputCapacity; // Capacity of output
+    size_t outputMax;      // Largest output allowed
+    bool tooBig;           // Whether outputMax was hit
+
+    Huffman lencode;  // Literal/length code of the current block
+    Huffman distcode; // Distance code of the current block
+};
+
+class Deflater
+{
+public:
+    Deflater(uint8_t windowBits, bool contextTakeover);
+    ~Deflater();
+
+    bool ready() const;                 // Whether the buffers could be allocated
+    static size_t bound(size_t length); // Largest compressed size of length bytes
+
+    // Compresses one message into output, which must hold bound(length) bytes.
+    // Returns the compressed length, or 0 when compressing doesn't make it smaller;
+    // the message must then be sent uncompressed and is left out of the history
+    size_t deflate(const uint8_t *data, size_t length, uint8_t *output);
+
+private:
+    uint8_t at(size_t position) const;       // Byte at a position of history followed by the message
+    uint32_t hash(size_t position) const;    // Hash of the 3 bytes at position
+    void putBits(uint32_t value, int count); // Writes bits, least significant first
+    void putCode(uint16_t code, int length); // Writes a Huffman code, most significant bit first
+    void putLiteral(int symbol);             // Writes a literal/length symbol with the fixed code
+
+    uint8_t windowBits;   // Largest distance is 2^windowBits
+    uint8_t *history;     // Last bytes of earlier messages, nullptr without context takeover
+    size_t historySize;   // Capacity of history
+    size_t historyLength; // Bytes in history
+    uint16_t *head;       // Last position + 1 of each hash, 0 when none
+
+    const uint8_t *message; // Message being compressed
+    uint8_t *out;           // Compressed output
+    size_t outLength;       // Bytes in out
+    uint32_t bitBuffer;     // Bits not written yet
+    int bitCount;           // Number of bits in bitBuffer
+};
@@ -1,16 +1,102 @@
 #include "http.hpp"
 #include "certs.hpp"
 #include "common.hpp"
-#include <ArduinoHttpClient.h>
+
+#define MAX_STREAM_RESUMES 3 // Reconnect attempts after a dropped stream
+
+// Returns "host[:port]" from a URL, with or without a scheme
+static String hostFromUrl(String url)
+{
+    int scheme = url.indexOf("://");
+    if (scheme != -1)
+    {
+        url.remove(0, scheme + 3);
+    }
+    int slash = url.indexOf('/');
+    if (slash != -1)
+    {
+        url.remove(slash);
+    }
+    return url;
+}
+
+// Keeps the Content-Range header for the success line, context is a 64-byte buffer
+static void collectContentRange(void *context, const char *name, const char *value)
+{
+    if (strcasecmp(name, "Content-Range") == 0)
+    {
+        snprintf((char *)context, 64, "%s", value);
+    }
+}
+
+// Hands a response body to ArduinoJson, which reads it as a stream
+class BodyReader
+{
+public:
+    BodyReader(HttpConnection &connection, HttpResponseParser &parser) : connection(connection), parser(parser), data(nullptr), position(0), length(0) {}
+
+    int read()
+    {
+        if (this->position == this->length)
+        {
+            int received = this->connection.readBody(this->parser, this->data, HTTP_BODY_TIMEOUT);
+            if (received <= 0)
+            {
+                return -1;
+            }
+            this->position = 0;
+            this->length = (size_t)received;
+        }
+        return this->data[this->position++];
+    }
+
+    size_t readBytes(char *buffer, size_t size)
+    {
+        size_t count = 0;
+        int c;
+        while (count < size && (c = this->read()) >= 0)
+        {
+            buffer[count++] = (char)c;
+        }
+        return count;
+    }
+
+private:
+    HttpConnection &connection;
+    HttpResponseParser &parser;
+    const uint8_t *data; // Body span returned by readBody
+    size_t position;     // Next byte of data
+    size_t length;       // Bytes in data
+};
+
+bool ClientStream::connect(const char *host, uint16_t port)
+{
+    if (this->client->connect(host, port))
+    {
+        return true;
+    }
+#ifndef BOARD_BW16
+    // certification failed? connect without SSL, then check certificates again for later connections
+    this->client->setInsecure();
+    bool connected = this->client->connect(host, port);
+    this->client->setCACert(root_ca);
+    return connected;
+#else
+    return false;
+#endif
+}
 
 #ifndef BOARD_BW16
 HTTP::HTTP(UART *uart, WiFiClientSecure *client)
 #else
 HTTP::HTTP(UART *uart, WiFiSSLClient *client)
 #endif
+    : clientStream(client), connection(&this->clientStream)
 {
     this->uart = uart;
     this->client = client;
+    this->writeBuffer = nullptr;
+    this->writeLength = 0;
 
 #ifndef BOARD_BW16
     this->client->setCACert(root_ca);
@@ -19,462 +105,740 @@ HTTP::HTTP(UART *uart, WiFiSSLClient *client)
 #endif
 }
 
-String HTTP::request(
-    const char *method,
-    String url,
-    String payload,
-    const char *headerKeys[],
-    const char *headerValues[],
-    int headerSize)
-#ifdef BOARD_BW16
+int HTTP::sendRequest(const char *method, const String &url, const String &payload, const char *headerKeys[], const char *headerValues[], int headerSize, const char *range, HttpResponseParser &parser)
 {
-    String response = "";                              // Initialize response string
-    this->client->setRootCA((unsigned char *)root_ca); // Set root CA for SSL
-    int index = url.indexOf('/');                      // Find the first occurrence of '/'
-    String host = url.substring(0, index);             // Extract host
-    String path = url.substring(index);                // Extract path
-
-    char host_server[64];                                    // Buffer for host server
-    strncpy(host_server, host.c_str(), sizeof(host_server)); // Copy host to buffer
-
-    if (this->client->connect(host_server, 443)) // Connect to the server
+    char host[HTTP_CORE_HOST_SIZE];
+    uint16_t port;
+    const char *path;
+    bool secure;
+    if (!httpSplitUrl(url.c_str(), host, sizeof(host), &port, &path, &secure))
     {
-        // Make a HTTP request:
-        this->client->print(method);
-        this->client->print(" ");
-        this->client->print(path);
-        this->client->println(" HTTP/1.1");
-        this->client->print("Host: ");
-        this->client->println(host_server);
-
-        // Add custom headers if provided
-        for (int i = 0; i < headerSize; i++)
-        {
-            this->client->print(headerKeys[i]);
-            this->client->print(": ");
-            this->client->println(headerValues[i]);
-        }
-
-        // Add payload if provided
-        if (payload != "")
-        {
-            this->client->print("Content-Length: ");
-            this->client->println(payload.length());
-            this->client->println("Content-Type: application/json");
-        }
-
-        this->client->println("Connection: close");
-        this->client->println();
-
-        // Send the payload in the request body
-        if (payload != "")
-        {
-            this->client->println(payload);
-        }
+        this->uart->println(F("[ERROR] Invalid URL."));
+        return -2;
+    }
+    if (headerSize > HTTP_MAX_HEADERS)
+    {
+        this->uart->println(F("[ERROR] Too many headers, at most 10 are supported."));
+        return -2;
+    }
 
-        // read everything that’s in the buffer, then stop
-        while (this->client->available())
-            response += this->client->readStringUntil('\n') + "\n";
-        this->client->stop();
+    // GET and HEAD carry no body. Any other payload is sent as JSON unless the caller says otherwise,
+    // and a range goes after the caller's headers
+    bool hasBody = payload.length() > 0 && strcmp(method, "GET") != 0 && strcmp(method, "HEAD") != 0;
+    const char *keys[HTTP_MAX_HEADERS + 2];
+    const char *values[HTTP_MAX_HEADERS + 2];
+    int count = 0;
+    bool hasContentType = false;
+    for (int i = 0; i < headerSize; i++)
+    {
+        keys[count] = headerKeys[i];
+        values[count] = headerValues[i];
+        hasContentType = hasContentType || strcasecmp(headerKeys[i], "Content-Type") == 0;
+        count++;
     }
-    else
+    if (hasBody && !hasContentType)
     {
-        this->uart->println(F("[ERROR] Unable to connect to the server."));
+        keys[count] = "Content-Type";
+        values[count] = "application/json";
+        count++;
+    }
+    if (range && range[0] != '\0')
+    {
+        keys[count] = "Range";
+        values[count] = range;
+        count++;
     }
 
-    // Clear serial buffer to avoid any residual data
-    this->uart->clearBuffer();
+    size_t headLength;
+    char *head = httpNewRequestHead(headLength, method, host, port, path, keys, values, count, hasBody ? (long)payload.length() : -2, true);
+    if (!head)
+    {
+        this->uart->println(F("[ERROR] Not enough memory for the request headers."));
+        return -2;
+    }
 
-    return response;
+    parser.reset(strcmp(method, "HEAD") == 0);
+    int status = this->connection.request(host, port, (const uint8_t *)head, headLength, (const uint8_t *)payload.c_str(), hasBody ? payload.length() : 0, parser, HTTP_HEADER_TIMEOUT);
+    free(head);
+    return status;
 }
-#else
+
+String HTTP::request(
+    const char *method,
+    String url,
+    String payload,
+    const char *headerKeys[],
+    const char *headerValues[],
+    int headerSize,
+    JsonDocument *filter)
 {
-    HTTPClient http;
     String response = "";
-
-    http.collectHeaders(headerKeys, headerSize);
-
-    if (http.begin(*this->client, url))
+    if (payload == "")
     {
-        for (int i = 0; i < headerSize; i++)
-        {
-            http.addHeader(headerKeys[i], headerValues[i]);
-        }
+        payload = "{}";
+    }
 
-        if (payload == "")
+    HttpResponseParser parser;
+    int statusCode = this->sendRequest(method, url, payload, headerKeys, headerValues, headerSize, nullptr, parser);
+    if (statusCode < 0)
+    {
+        if (statusCode == -1)
         {
-            payload = "{}";
+            this->uart->println(F("[ERROR] Unable to connect to the server."));
         }
+        this->uart->clearBuffer();
+        return response;
+    }
 
-        int statusCode = http.sendRequest(method, payload);
-        char headerResponse[512];
+    char headerResponse[128];
+    snprintf(headerResponse, sizeof(headerResponse), "[%s/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%ld}", method, statusCode, parser.contentLength());
+    this->uart->println(headerResponse);
 
-        if (statusCode > 0)
+    if (filter)
+    {
+        response = this->filterResponse(parser, *filter);
+    }
+    else
+    {
+        // Read the whole body, however many segments it arrives in
+        if (parser.contentLength() > 0)
         {
-            snprintf(headerResponse, sizeof(headerResponse), "[%s/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%d}", method, statusCode, http.getSize());
-            this->uart->println(headerResponse);
-            response = http.getString();
-            http.end();
-            return response;
+            response.reserve(parser.contentLength());
         }
-        else
+        const uint8_t *data;
+        int length;
+        while ((length = this->connection.readBody(parser, data, HTTP_BODY_TIMEOUT)) > 0)
         {
-            if (statusCode != -1) // HTTPC_ERROR_CONNECTION_FAILED
+            for (int i = 0; i < length; i++)
             {
-                snprintf(headerResponse, sizeof(headerResponse), "[ERROR] %s Request Failed, error: %s", method, http.errorToString(statusCode).c_str());
-                this->uart->println(headerResponse);
-            }
-            else // certification failed?
-            {
-                // send request without SSL
-                http.end();
-                this->client->setInsecure();
-                if (http.begin(*this->client, url))
-                {
-                    for (int i = 0; i < headerSize; i++)
-                    {
-                        http.addHeader(headerKeys[i], headerValues[i]);
-                    }
-                    int newCode = http.sendRequest(method, payload);
-                    if (newCode > 0)
-                    {
-                        snprintf(headerResponse, sizeof(headerResponse), "[%s/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%d}", method, newCode, http.getSize());
-                        this->uart->println(headerResponse);
-                        response = http.getString();
-                        http.end();
-                        this->client->setCACert(root_ca);
-                        return response;
-                    }
-                    else
-                    {
-                        this->client->setCACert(root_ca);
-                        snprintf(headerResponse, sizeof(headerResponse), "[ERROR] %s Request Failed, error: %s", method, http.errorToString(newCode).c_str());
-                        this->uart->println(headerResponse);
-                    }
-                }
+                response += (char)data[i];
             }
         }
-        http.end();
-    }
-    else
-    {
-        this->uart->println(F("[ERROR] Unable to connect to the server."));
     }
+    this->connection.end(parser);
 
     // Clear serial buffer to avoid any residual data
     this->uart->clearBuffer();
 
     return response;
 }
-#endif
 
-bool HTTP::stream(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize)
-#ifdef BOARD_BW16
+String HTTP::filterResponse(HttpResponseParser &parser, JsonDocument &filter)
 {
-    // Not implemented for BW16
-    this->uart->print(F("[ERROR] streamBytes not implemented for BW16."));
-    this->uart->print(method);
-    this->uart->print(url);
-    this->uart->print(payload);
-    for (int i = 0; i < headerSize; i++)
+    // Parse straight off the connection so only the projected fields are ever stored
+    String output;
+    JsonDocument doc;
+    BodyReader reader(this->connection, parser);
+    if (!deserializeJson(doc, reader, DeserializationOption::Filter(filter)))
     {
-        this->uart->print(headerKeys[i]);
-        this->uart->print(headerValues[i]);
+        serializeJson(doc, output);
     }
-    this->uart->println();
-    return false;
+    if (output == "")
+    {
+        this->uart->println(F("[ERROR] Failed to filter JSON response."));
+    }
+    return output;
 }
-#else
+
+bool HTTP::stream(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize, size_t offset, size_t length, bool resume)
 {
-    HTTPClient http;
+    return this->streamResponse(method, url, payload, headerKeys, headerValues, headerSize, offset, length, resume, nullptr, 0);
+}
 
-    http.collectHeaders(headerKeys, headerSize);
+bool HTTP::streamResponse(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize, size_t offset, size_t length, bool resume, Print *sink, size_t sinkLimit)
+{
+    char headerResponse[256];
+    char contentRange[64];                // Content-Range of the response, echoed in the success header
+    const size_t minHeapThreshold = 1024; // Minimum heap space to avoid overflow
+    size_t written = 0;                   // Body bytes already forwarded over UART (or to the sink)
+    int resumes = 0;                      // Number of reconnects after a dropped connection
+    bool started = false;                 // Whether the success header has been sent
+    bool complete = false;                // Whether the whole body arrived
+    int statusCode = 0;                   // Status code of the first response
+    long expected = -1;                   // Body length announced by the first response, -1 if unknown
+    HttpResponseParser parser;
+    parser.onHeader(collectContentRange, contentRange);
+
+    if (payload == "")
+    {
+        payload = "{}";
+    }
 
-    if (http.begin(*this->client, url))
+    while (true)
     {
-        for (int i = 0; i < headerSize; i++)
+        // Ask for a byte range when an offset/length was given, or to continue after a drop
+        char range[48] = {0};
+        if (offset > 0 || length > 0 || written > 0)
         {
-            http.addHeader(headerKeys[i], headerValues[i]);
+            if (length > 0)
+            {
+                snprintf(range, sizeof(range), "bytes=%lu-%lu", (unsigned long)(offset + written), (unsigned long)(offset + length - 1));
+            }
+            else
+            {
+                snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)(offset + written));
+            }
         }
 
-        if (payload == "")
+        contentRange[0] = '\0';
+        int httpCode = this->sendRequest(method, url, payload, headerKeys, headerValues, headerSize, range, parser);
+        if (httpCode < 0)
         {
-            payload = "{}";
+            if (started)
+            {
+                break; // resume failed, finish with what was sent so far
+            }
+            if (httpCode == -1)
+            {
+                this->uart->println(F("[ERROR] Unable to connect to the server."));
+            }
+            return false;
         }
 
-        int httpCode = http.sendRequest(method, payload);
-        int len = http.getSize(); // Get the response content length
-        char headerResponse[256];
-        if (httpCode > 0)
+        if (!started)
         {
-            snprintf(headerResponse, sizeof(headerResponse), "[%s/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%d}", method, httpCode, len);
-            this->uart->println(headerResponse);
-            uint8_t buff[512] = {0}; // Buffer for reading data
+            long len = parser.contentLength();
+            if (sink)
+            {
+                // Refuse up front when the announced body can't fit in flash
+                if (len > 0 && (size_t)len > sinkLimit)
+                {
+                    snprintf(headerResponse, sizeof(headerResponse), "[ERROR] Download is larger than the free flash space (%lu bytes free).", (unsigned long)sinkLimit);
+                    this->uart->println(headerResponse);
+                    this->connection.close();
+                    return false;
+                }
+            }
+            else if (contentRange[0] != '\0')
+            {
+                snprintf(headerResponse, sizeof(headerResponse), "[%s/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%ld,\"Content-Range\":\"%s\"}", method, httpCode, len, contentRange);
+                this->uart->println(headerResponse);
+            }
+            else
+            {
+                snprintf(headerResponse, sizeof(headerResponse), "[%s/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%ld}", method, httpCode, len);
+                this->uart->println(headerResponse);
+            }
+            started = true;
+            statusCode = httpCode;
+            expected = len;
 
-            WiFiClient *stream = http.getStreamPtr();
+            // Only successful bodies can be continued with a Range request
+            if (httpCode != 200 && httpCode != 206)
+            {
+                resume = false;
+            }
+            else if (httpCode == 200)
+            {
+                // The server ignored the range and sent the whole body, so a resume continues from its start
+                offset = 0;
+                length = 0;
+            }
 
-            size_t freeHeap = commonGetFreeHeap(); // Check available heap memory before starting
-            const size_t minHeapThreshold = 1024;  // Minimum heap space to avoid overflow
-            if (freeHeap < minHeapThreshold)
+            if (commonGetFreeHeap() < minHeapThreshold) // Check available heap memory before starting
             {
                 this->uart->println(F("[ERROR] Not enough memory to start processing the response."));
-                http.end();
+                this->connection.close();
                 return false;
             }
+        }
+        else if (httpCode != 206)
+        {
+            // The server ignored the range on reconnect, so the remaining bytes can't be spliced in
+            this->connection.close();
+            break;
+        }
 
-            // Start timeout timer
-            unsigned long timeoutStart = millis();
-            const unsigned long timeoutInterval = 2000; // 2 seconds
-
-            // Stream data while connected and available
-            while (http.connected() && (len > 0 || len == -1))
+        // Body spans go straight from the receive buffer to UART (or the sink), with any chunked framing removed
+        const uint8_t *data;
+        int received;
+        while ((received = this->connection.readBody(parser, data, HTTP_BODY_TIMEOUT)) > 0)
+        {
+            if (sink)
             {
-                size_t size = stream->available();
-                if (size)
+                if (written + received > sinkLimit || sink->write(data, received) != (size_t)received)
                 {
-                    // Reset the timeout when new data comes in
-                    timeoutStart = millis();
-
-                    int c = stream->readBytes(buff, ((size > sizeof(buff)) ? sizeof(buff) : size));
-                    this->uart->write(buff, c); // Write data to serial
-                    if (len > 0)
-                    {
-                        len -= c;
-                    }
+                    snprintf(headerResponse, sizeof(headerResponse), "[ERROR] Download is larger than the free flash space (%lu bytes free).", (unsigned long)sinkLimit);
+                    this->uart->println(headerResponse);
+                    this->connection.close();
+                    return false;
                 }
-                else
-                {
-                    // Check if timeout has been reached
-                    if (millis() - timeoutStart > timeoutInterval)
-                    {
-                        break;
-                    }
-                }
-                delay(1); // Yield control to the system
             }
-            freeHeap = commonGetFreeHeap(); // Check available heap memory after processing
-            if (freeHeap < minHeapThreshold)
+            else
             {
-                this->uart->println(F("[ERROR] Not enough memory to continue processing the response."));
-                http.end();
-                return false;
+                this->uart->write(data, received);
             }
+            written += received;
+        }
+        complete = parser.done();
+        this->connection.end(parser);
 
-            http.end();
-            // Flush the serial buffer to ensure all data is sent
-            this->uart->flush();
-            this->uart->println();
-            if (strcmp(method, "GET") == 0)
+        if (commonGetFreeHeap() < minHeapThreshold) // Check available heap memory after processing
+        {
+            this->uart->println(F("[ERROR] Not enough memory to continue processing the response."));
+            return false;
+        }
+
+        if (complete || !resume || resumes >= MAX_STREAM_RESUMES)
+        {
+            break;
+        }
+        resumes++;
+        delay(250); // Give the network a moment before reconnecting
+    }
+
+    if (sink)
+    {
+        // A short body isn't kept as if it were the whole download
+        if (!complete)
+        {
+            if (expected >= 0)
             {
-                this->uart->println(F("[GET/END]"));
+                snprintf(headerResponse, sizeof(headerResponse), "[ERROR] Download ended after %lu of %ld bytes.", (unsigned long)written, expected);
             }
             else
             {
-                this->uart->println(F("[POST/END]"));
+                snprintf(headerResponse, sizeof(headerResponse), "[ERROR] Download ended after %lu bytes.", (unsigned long)written);
             }
-            return true;
+            this->uart->println(headerResponse);
+            return false;
+        }
+        snprintf(headerResponse, sizeof(headerResponse), "[FILE/STORED]{\"Status-Code\":%d,\"size\":%lu,\"free\":%lu}", statusCode, (unsigned long)written, (unsigned long)(sinkLimit - written));
+        this->uart->println(headerResponse);
+        return true;
+    }
+
+    // Flush the serial buffer to ensure all data is sent
+    this->uart->flush();
+    this->uart->println();
+    if (!complete)
+    {
+        // Tell the Flipper the body was cut short, and how much of it arrived
+        if (expected >= 0)
+        {
+            snprintf(headerResponse, sizeof(headerResponse), "[ERROR] Response ended after %lu of %ld bytes.", (unsigned long)written, expected);
         }
         else
         {
-            if (httpCode != -1) // HTTPC_ERROR_CONNECTION_FAILED
-            {
-                snprintf(headerResponse, sizeof(headerResponse), "[ERROR] %s Request Failed, error: %s", method, http.errorToString(httpCode).c_str());
-                this->uart->println(headerResponse);
-            }
-            else // certification failed?
-            {
-                // Send request without SSL
-                http.end();
-                this->client->setInsecure();
-                if (http.begin(*this->client, url))
-                {
-                    for (int i = 0; i < headerSize; i++)
-                    {
-                        http.addHeader(headerKeys[i], headerValues[i]);
-                    }
-                    int newCode = http.sendRequest(method, payload);
-                    int len = http.getSize(); // Get the response content length
-                    if (newCode > 0)
-                    {
-                        snprintf(headerResponse, sizeof(headerResponse), "[%s/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%d}", method, newCode, len);
-                        this->uart->println(headerResponse);
-                        uint8_t buff[512] = {0}; // Buffer for reading data
-
-                        WiFiClient *stream = http.getStreamPtr();
-
-                        // Check available heap memory before starting
-                        size_t freeHeap = commonGetFreeHeap();
-                        if (freeHeap < 1024)
-                        {
-                            this->uart->println(F("[ERROR] Not enough memory to start processing the response."));
-                            http.end();
-                            this->client->setCACert(root_ca);
-                            return false;
-                        }
-
-                        // Start timeout timer
-                        unsigned long timeoutStart = millis();
-                        const unsigned long timeoutInterval = 2000; // 2 seconds
-
-                        // Stream data while connected and available
-                        while (http.connected() && (len > 0 || len == -1))
-                        {
-                            size_t size = stream->available();
-                            if (size)
-                            {
-                                // Reset the timeout when new data arrives
-                                timeoutStart = millis();
-
-                                int c = stream->readBytes(buff, ((size > sizeof(buff)) ? sizeof(buff) : size));
-                                this->uart->write(buff, c); // Write data to serial
-                                if (len > 0)
-                                {
-                                    len -= c;
-                                }
-                            }
-                            else
-                            {
-                                // Check if timeout has been reached
-                                if (millis() - timeoutStart > timeoutInterval)
-                                {
-                                    break;
-                                }
-                            }
-                            delay(1); // Yield control to the system
-                        }
-
-                        freeHeap = commonGetFreeHeap(); // Check available heap memory after processing
-                        if (freeHeap < 1024)
-                        {
-                            this->uart->println(F("[ERROR] Not enough memory to continue processing the response."));
-                            http.end();
-                            this->client->setCACert(root_ca);
-                            return false;
-                        }
-
-                        http.end();
-                        // Flush the serial buffer to ensure all data is sent
-                        this->uart->flush();
-                        this->uart->println();
-                        if (strcmp(method, "GET") == 0)
-                        {
-                            this->uart->println(F("[GET/END]"));
-                        }
-                        else
-                        {
-                            this->uart->println(F("[POST/END]"));
-                        }
-                        this->client->setCACert(root_ca);
-                        return true;
-                    }
-                    else
-                    {
-                        this->client->setCACert(root_ca);
-                        snprintf(headerResponse, sizeof(headerResponse), "[ERROR] %s Request Failed, error: %s", method, http.errorToString(newCode).c_str());
-                        this->uart->println(headerResponse);
-                    }
-                }
-                this->client->setCACert(root_ca);
-            }
+            snprintf(headerResponse, sizeof(headerResponse), "[ERROR] Response ended after %lu bytes.", (unsigned long)written);
         }
-        http.end();
+        this->uart->println(headerResponse);
+    }
+    if (strcmp(method, "GET") == 0)
+    {
+        this->uart->println(F("[GET/END]"));
     }
     else
     {
-        this->uart->println(F("[ERROR] Unable to connect to the server."));
+        this->uart->println(F("[POST/END]"));
     }
-    return false;
+    return true;
 }
-#endif
 
-bool HTTP::streamUpload(const char *method, String url, size_t fileSize, String contentType, const char *headerKeys[], const char *headerValues[], int headerSize)
+bool HTTP::download(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize, const char *path, size_t offset, size_t length)
 #ifdef BOARD_BW16
 {
-    this->uart->println(F("[ERROR] streamUpload not implemented for BW16."));
+    this->uart->println(F("[ERROR] Downloading to flash is not supported on BW16."));
     return false;
 }
 #else
 {
-    // Parse URL into host and path
-    String host, path;
-    int port = 443;
+    // Only one download is kept, so the previous one's space counts as free
+    StorageManager storage;
+    storage.remove(path);
+    size_t limit = storage.freeSpace();
+    File file = storage.open(path, "w");
+    if (!file)
+    {
+        this->uart->println(F("[ERROR] Failed to create the download file."));
+        return false;
+    }
+    bool stored = this->streamResponse(method, url, payload, headerKeys, headerValues, headerSize, offset, length, true, &file, limit);
+    file.close();
+    if (!stored)
+    {
+        storage.remove(path);
+    }
+    return stored;
+}
+#endif
+
+bool HTTP::streamJsonPath(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize, JsonPath &path)
+{
+    char headerResponse[128];
 
-    if (url.startsWith("https://"))
+    if (payload == "")
     {
-        url.remove(0, 8);
-        port = 443;
+        payload = "{}";
     }
-    else if (url.startsWith("http://"))
+
+    HttpResponseParser parser;
+    int httpCode = this->sendRequest(method, url, payload, headerKeys, headerValues, headerSize, nullptr, parser);
+    if (httpCode < 0)
+    {
+        if (httpCode == -1)
+        {
+            this->uart->println(F("[ERROR] Unable to connect to the server."));
+        }
+        return false;
+    }
+
+    snprintf(headerResponse, sizeof(headerResponse), "[%s/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%ld}", method, httpCode, parser.contentLength());
+    this->uart->println(headerResponse);
+
+    // Feed the parser until the body ends or no further match is possible
+    path.reset();
+    const uint8_t *data;
+    int received;
+    while (!path.done() && (received = this->connection.readBody(parser, data, HTTP_BODY_TIMEOUT)) > 0)
     {
-        url.remove(0, 7);
-        port = 80;
+        path.feed(data, received);
     }
+    this->connection.end(parser);
 
-    int slashIdx = url.indexOf('/');
-    if (slashIdx != -1)
+    this->uart->flush();
+    if (path.failed())
+    {
+        this->uart->println(F("[ERROR] Failed to parse JSON."));
+    }
+    else if (!path.done())
+    {
+        // The body stalled or closed inside the document, so later matches may be missing
+        this->uart->println(F("[ERROR] Response ended before the JSON document was complete."));
+    }
+    if (strcmp(method, "GET") == 0)
     {
-        host = url.substring(0, slashIdx);
-        path = url.substring(slashIdx);
+        this->uart->println(F("[GET/END]"));
     }
     else
     {
-        host = url;
-        path = "/";
+        this->uart->println(F("[POST/END]"));
+    }
+    return true;
+}
+
+int HTTP::fetchRange(const String &url, const char *headerKeys[], const char *headerValues[], int headerSize, size_t offset, uint8_t *buffer, size_t size, size_t &total)
+{
+    char range[48];
+    snprintf(range, sizeof(range), "bytes=%lu-%lu", (unsigned long)offset, (unsigned long)(offset + size - 1));
+
+    char contentRange[64] = {0};
+    HttpResponseParser parser;
+    parser.onHeader(collectContentRange, contentRange);
+    int httpCode = this->sendRequest("GET", url, "", headerKeys, headerValues, headerSize, range, parser);
+    if (httpCode < 0)
+    {
+        return -1;
     }
 
-    // Connect to the server before signalling ready, so the device
-    // doesn't start sending bytes to an unconnected upload.
-    if (!this->client->connect(host.c_str(), port))
+    total = 0;
+    if (httpCode == 206)
     {
-        this->client->setInsecure();
-        if (!this->client->connect(host.c_str(), port))
+        // Content-Range: bytes 0-1023/4096, or bytes 0-1023/* when the server doesn't know the total
+        const char *slash = strrchr(contentRange, '/');
+        if (slash && slash[1] != '*')
         {
-            this->uart->println(F("[ERROR] Failed to connect to server for upload."));
-            this->client->setCACert(root_ca);
-            return false;
+            total = (size_t)strtoul(slash + 1, nullptr, 10);
         }
     }
+    else if (httpCode != 200 || offset != 0 || parser.contentLength() > (long)size)
+    {
+        // Past the end, no range support for a larger file, or an error status
+        this->connection.close();
+        return httpCode == 416 ? 0 : -1;
+    }
 
-    // Send HTTP request line and headers
-    this->client->print(method);
-    this->client->print(F(" "));
-    this->client->print(path);
-    this->client->println(F(" HTTP/1.1"));
-    this->client->print(F("Host: "));
-    this->client->println(host);
-    this->client->print(F("Content-Type: "));
-    this->client->println(contentType);
-    this->client->print(F("Content-Length: "));
-    this->client->println(fileSize);
+    size_t received = 0;
+    const uint8_t *data;
+    int length;
+    while ((length = this->connection.readBody(parser, data, HTTP_BODY_TIMEOUT)) > 0)
+    {
+        if (received + length > size)
+        {
+            this->connection.close();
+            return -1;
+        }
+        memcpy(buffer + received, data, length);
+        received += length;
+    }
+    bool complete = parser.done();
+    this->connection.end(parser);
+    if (!complete)
+    {
+        return -1;
+    }
+    if (httpCode == 200)
+    {
+        total = received; // the server ignored the range, but the whole file fit
+    }
+    return (int)received;
+}
+
+bool HTTP::streamUpload(const char *method, String url, size_t fileSize, String contentType, const char *headerKeys[], const char *headerValues[], int headerSize, const char *fieldKeys[], const char *fieldValues[], int fieldSize, const char *fileField, const char *fileName, const char *sourcePath)
+{
+#ifdef BOARD_BW16
+    if (sourcePath)
+    {
+        this->uart->println(F("[ERROR] Spooled uploads are not supported on BW16."));
+        return false;
+    }
+#endif
+
+    char host[HTTP_CORE_HOST_SIZE];
+    uint16_t port;
+    const char *path;
+    bool secure;
+    if (!httpSplitUrl(url.c_str(), host, sizeof(host), &port, &path, &secure))
+    {
+        this->uart->println(F("[ERROR] Invalid URL."));
+        return false;
+    }
+    if (headerSize > HTTP_MAX_HEADERS)
+    {
+        this->uart->println(F("[ERROR] Too many headers, at most 10 are supported."));
+        return false;
+    }
+
+    // Multipart bodies are framed on the fly: the form fields and the file part's
+    // headers go before the streamed bytes and the closing boundary after them
+    String preamble = "";
+    String epilogue = "";
+    if (fileName)
+    {
+        String boundary = "----FlipperHTTP" + String((uint32_t)random(0x7FFFFFFF), HEX) + String((uint32_t)millis(), HEX);
+        for (int i = 0; i < fieldSize; i++)
+        {
+            preamble += "--" + boundary + "\r\nContent-Disposition: form-data; name=\"" + fieldKeys[i] + "\"\r\n\r\n" + fieldValues[i] + "\r\n";
+        }
+        preamble += "--" + boundary + "\r\nContent-Disposition: form-data; name=\"" + fileField + "\"; filename=\"" + fileName + "\"\r\n";
+        preamble += "Content-Type: " + contentType + "\r\n\r\n";
+        epilogue = "\r\n--" + boundary + "--\r\n";
+        contentType = "multipart/form-data; boundary=" + boundary;
+    }
+    bool chunked = fileSize == 0;
+
+    // The upload closes its connection afterwards unless the caller asks otherwise
+    const char *keys[HTTP_MAX_HEADERS + 1];
+    const char *values[HTTP_MAX_HEADERS + 1];
+    keys[0] = "Content-Type";
+    values[0] = contentType.c_str();
+    bool hasConnection = false;
     for (int i = 0; i < headerSize; i++)
     {
-        this->client->print(headerKeys[i]);
-        this->client->print(F(": "));
-        this->client->println(headerValues[i]);
+        keys[i + 1] = headerKeys[i];
+        values[i + 1] = headerValues[i];
+        hasConnection = hasConnection || strcasecmp(headerKeys[i], "Connection") == 0;
     }
-    this->client->println(F("Connection: close"));
-    this->client->println(); // blank line ends headers
+    long contentLength = chunked ? -1 : (long)(preamble.length() + fileSize + epilogue.length());
+    char chunkHeader[20]; // "<hex length>\r\n" of the next chunk
 
-    // Signal the UART device that we are ready for raw bytes
-    this->uart->println(F("[FILE/READY]"));
+    // A spooled file can be sent again, so only those uploads are retried
+#ifndef BOARD_BW16
+    File source;
+#endif
+    HttpResponseParser parser;
+    int statusCode = -1;
+    int attempts = sourcePath ? HTTP_UPLOAD_ATTEMPTS : 1;
+    for (int attempt = 1;; attempt++)
+    {
+        bool lastAttempt = attempt >= attempts;
+        if (attempt > 1)
+        {
+            delay(1000 * (attempt - 1)); // back off before reconnecting
+        }
+
+        // The upload always opens its own connection. Connect to the server before
+        // signalling ready, so the device doesn't start sending bytes to an unconnected upload.
+        this->connection.close();
+        if (!this->connection.open(host, port))
+        {
+            if (lastAttempt)
+            {
+                this->uart->println(F("[ERROR] Failed to connect to server for upload."));
+                return false;
+            }
+            continue;
+        }
+
+#ifndef BOARD_BW16
+        if (sourcePath)
+        {
+            StorageManager storage;
+            source = storage.open(sourcePath, "r");
+            if (!source)
+            {
+                this->uart->println(F("[ERROR] Failed to open spooled upload."));
+                this->connection.close();
+                return false;
+            }
+        }
+#endif
+
+        // The request head is queued as one write so it shares a TLS record with the first body bytes
+        size_t headLength;
+        char *head = httpNewRequestHead(headLength, method, host, port, path, keys, values, headerSize + 1, contentLength, hasConnection);
+        if (!head)
+        {
+            this->uart->println(F("[ERROR] Not enough memory for the request headers."));
+            this->connection.close();
+            return false;
+        }
+        this->beginWrites();
+        this->queueWrite((const uint8_t *)head, headLength);
+        free(head);
+
+        bool sent = true;
+#ifndef BOARD_BW16
+        if (sourcePath)
+        {
+            this->queueWrite(preamble);
+            sent = this->pipeUpload(fileSize, &source);
+            this->queueWrite(epilogue);
+            source.close();
+        }
+        else
+#endif
+        {
+            // Signal the UART device that we are ready for raw bytes
+            this->uart->println(F("[FILE/READY]"));
+            this->uart->flush();
+
+            if (chunked)
+            {
+                // Each "<length>\n" from the device becomes one HTTP chunk of the same size
+                if (preamble.length() > 0)
+                {
+                    this->queueWrite((const uint8_t *)chunkHeader, httpWriteChunkHeader(chunkHeader, sizeof(chunkHeader), preamble.length()));
+                    this->queueWrite(preamble + "\r\n");
+                }
+                while (sent)
+                {
+                    String lengthLine = this->uart->readStringUntilString("\n", 5000);
+                    if (lengthLine.length() == 0)
+                    {
+                        this->uart->println(F("[ERROR] Upload timed out waiting for data."));
+                        sent = false;
+                        break;
+                    }
+                    size_t length = (size_t)strtoul(lengthLine.c_str(), nullptr, 10);
+                    if (length == 0)
+                    {
+                        break;
+                    }
+                    this->queueWrite((const uint8_t *)chunkHeader, httpWriteChunkHeader(chunkHeader, sizeof(chunkHeader), length));
+                    sent = this->pipeUpload(length);
+                    this->queueWrite("\r\n");
+                }
+                if (sent)
+                {
+                    if (epilogue.length() > 0)
+                    {
+                        this->queueWrite((const uint8_t *)chunkHeader, httpWriteChunkHeader(chunkHeader, sizeof(chunkHeader), epilogue.length()));
+                        this->queueWrite(epilogue + "\r\n");
+                    }
+                    this->queueWrite("0\r\n\r\n");
+                }
+            }
+            else
+            {
+                this->queueWrite(preamble);
+                sent = this->pipeUpload(fileSize);
+                this->queueWrite(epilogue);
+            }
+        }
+        sent = sent && this->flushWrites();
+        this->endWrites();
+
+        if (sent)
+        {
+            // The status line and headers are parsed as they arrive, however the segments split them
+            parser.reset();
+            statusCode = this->connection.readHeaders(parser, HTTP_HEADER_TIMEOUT);
+            if (statusCode >= 0)
+            {
+                break;
+            }
+        }
+
+        this->connection.close();
+        if (lastAttempt)
+        {
+            if (sourcePath)
+            {
+                this->uart->println(F("[ERROR] Spooled upload failed after retries."));
+            }
+            else if (sent)
+            {
+                this->uart->println(F("[ERROR] No response from the server."));
+            }
+            return false;
+        }
+    }
+
+    char headerResponse[128];
+    snprintf(headerResponse, sizeof(headerResponse),
+             "[POST/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%ld}", statusCode, parser.contentLength());
+    this->uart->println(headerResponse);
+
+    // Stream the response body back over UART, with any chunked framing removed
+    const uint8_t *data;
+    int received;
+    while ((received = this->connection.readBody(parser, data, HTTP_BODY_TIMEOUT)) > 0)
+    {
+        this->uart->write(data, received);
+    }
+
+    this->connection.close();
     this->uart->flush();
+    this->uart->println();
+    this->uart->println(F("[POST/END]"));
+    return true;
+}
 
-    // Stream body: read chunks from UART and write directly to the HTTP connection
+bool HTTP::pipeUpload(size_t length, Stream *source)
+{
+    // Read UART (or the spooled file) straight into the write buffer, which is sent whenever it fills up
     uint8_t buf[128];
-    size_t remaining = fileSize;
+    size_t remaining = length;
     unsigned long timeoutStart = millis();
     const unsigned long chunkTimeout = 5000; // 5 s without new data = abort
 
     while (remaining > 0)
     {
-        size_t avail = this->uart->available();
+        size_t avail = source ? (size_t)source->available() : this->uart->available();
+        if (source && avail == 0)
+        {
+            this->uart->println(F("[ERROR] Spooled upload is shorter than expected."));
+            return false;
+        }
         if (avail > 0)
         {
+            uint8_t *target = buf;
+            size_t space = sizeof(buf);
+            if (this->writeBuffer)
+            {
+                if (this->writeLength == HTTP_WRITE_BUFFER_SIZE && !this->flushWrites())
+                {
+                    this->uart->println(F("[ERROR] Upload connection lost."));
+                    return false;
+                }
+                target = this->writeBuffer + this->writeLength;
+                space = HTTP_WRITE_BUFFER_SIZE - this->writeLength;
+            }
             size_t toRead = avail < remaining ? avail : remaining;
-            if (toRead > sizeof(buf))
+            if (toRead > space)
+                toRead = space;
+            if (toRead > sizeof(buf)) // UART::readBytes reports at most 255 bytes per call
                 toRead = sizeof(buf);
-            size_t bytesRead = this->uart->readBytes(buf, (uint8_t)toRead);
-            this->client->write(buf, bytesRead);
+            size_t bytesRead = source ? source->readBytes((char *)target, toRead) : this->uart->readBytes(target, (uint8_t)toRead);
+            if (this->writeBuffer)
+            {
+                this->writeLength += bytesRead;
+            }
+            else
+            {
+                this->client->write(buf, bytesRead);
+            }
             remaining -= bytesRead;
             timeoutStart = millis();
         }
@@ -483,75 +847,122 @@ bool HTTP::streamUpload(const char *method, String url, size_t fileSize, String
             if (millis() - timeoutStart > chunkTimeout)
             {
                 this->uart->println(F("[ERROR] Upload timed out waiting for data."));
-                this->client->stop();
-                this->client->setCACert(root_ca);
                 return false;
             }
             delay(1);
         }
     }
+    return true;
+}
 
-    // Wait for the server's response headers to arrive
-    unsigned long responseTimeout = millis();
-    while (!this->client->available() && millis() - responseTimeout < 5000)
+void HTTP::beginWrites()
+{
+    this->writeLength = 0;
+    if (!this->writeBuffer)
     {
-        delay(1);
+        // Without the buffer, writes fall back to going straight to the client
+        this->writeBuffer = (uint8_t *)malloc(HTTP_WRITE_BUFFER_SIZE);
     }
+}
 
-    // Parse HTTP status line: "HTTP/1.1 200 OK\r\n"
-    int statusCode = 0;
-    String statusLine = this->client->readStringUntil('\n');
-    statusLine.trim();
-    int sp = statusLine.indexOf(' ');
-    if (sp != -1)
+void HTTP::queueWrite(const uint8_t *data, size_t size)
+{
+    if (!this->writeBuffer)
     {
-        statusCode = statusLine.substring(sp + 1, sp + 4).toInt();
+        this->client->write(data, size);
+        return;
     }
-
-    // Parse response headers: capture Content-Length, stop at blank line
-    int contentLength = -1;
-    while (this->client->available())
+    while (size > 0)
     {
-        String headerLine = this->client->readStringUntil('\n');
-        headerLine.trim();
-        if (headerLine.length() == 0)
-            break;
-        if (headerLine.startsWith("Content-Length:") || headerLine.startsWith("content-length:"))
+        if (this->writeLength == HTTP_WRITE_BUFFER_SIZE)
+        {
+            this->flushWrites();
+        }
+        size_t count = HTTP_WRITE_BUFFER_SIZE - this->writeLength;
+        if (count > size)
         {
-            contentLength = headerLine.substring(headerLine.indexOf(':') + 1).toInt();
+            count = size;
         }
+        memcpy(this->writeBuffer + this->writeLength, data, count);
+        this->writeLength += count;
+        data += count;
+        size -= count;
     }
+}
 
-    // Stream response body back over UART in chunks
-    uint8_t rbuf[512] = {0};
-    char headerResponse[128];
-    snprintf(headerResponse, sizeof(headerResponse),
-             "[POST/SUCCESS]{\"Status-Code\":%d,\"Content-Length\":%d}", statusCode, contentLength);
-    this->uart->println(headerResponse);
+void HTTP::queueWrite(const String &data)
+{
+    this->queueWrite((const uint8_t *)data.c_str(), data.length());
+}
 
-    unsigned long bodyTimeout = millis();
-    while (this->client->connected())
+bool HTTP::flushWrites()
+{
+    if (!this->writeBuffer || this->writeLength == 0)
     {
-        size_t size = this->client->available();
-        if (size)
+        return this->client->connected();
+    }
+    size_t written = this->client->write(this->writeBuffer, this->writeLength);
+    bool complete = written == this->writeLength;
+    this->writeLength = 0;
+    return complete;
+}
+
+void HTTP::endWrites()
+{
+    // The buffer is only held for the duration of an upload
+    free(this->writeBuffer);
+    this->writeBuffer = nullptr;
+    this->writeLength = 0;
+}
+
+int HTTP::prewarm(const char *hosts[], int hostCount)
+{
+    int resolved = 0;
+    String connected = "";
+    for (int i = 0; i < hostCount; i++)
+    {
+        char name[HTTP_CORE_HOST_SIZE];
+        uint16_t port;
+        const char *path;
+        bool secure;
+        if (!httpSplitUrl(hosts[i], name, sizeof(name), &port, &path, &secure))
         {
-            bodyTimeout = millis();
-            int c = this->client->readBytes(rbuf, size > sizeof(rbuf) ? sizeof(rbuf) : size);
-            this->uart->write(rbuf, c);
+            continue;
         }
-        else
+
+        // Resolving fills the network stack's DNS table, which honours the record TTL
+        IPAddress ip;
+        if (!WiFi.hostByName(name, ip))
         {
-            if (millis() - bodyTimeout > 2000)
-                break;
-            delay(1);
+            continue;
+        }
+        resolved++;
+
+        // The shared connection holds one host, so only the first https host is pre-opened.
+        // A connection to it that is still fresh is kept as it is
+        if (!secure || connected != "")
+        {
+            continue;
+        }
+        if (this->connection.open(name, port))
+        {
+            connected = hostFromUrl(hosts[i]);
         }
     }
 
-    this->client->stop();
-    this->client->setCACert(root_ca);
-    this->uart->flush();
-    this->uart->println();
-    this->uart->println(F("[POST/END]"));
-    return true;
+    char response[160];
+    if (resolved == 0)
+    {
+        snprintf(response, sizeof(response), "[ERROR] Failed to resolve any of %d hosts.", hostCount);
+    }
+    else if (connected != "")
+    {
+        snprintf(response, sizeof(response), "[SUCCESS] Resolved %d of %d hosts, connected to %s.", resolved, hostCount, connected.c_str());
+    }
+    else
+    {
+        snprintf(response, sizeof(response), "[SUCCESS] Resolved %d of %d hosts.", resolved, hostCount);
+    }
+    this->uart->println(response);
+    return resolved;
 }
-#endif
\ No newline at end of file
@@ -1,8 +1,44 @@
 #pragma once
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include "wifi_utils.hpp"
 #include "uart.hpp"
 #include "boards.hpp"
+#include "json_path.hpp"
+#include "storage.hpp"
+#include "http_core.hpp"
+
+#define HTTP_WRITE_BUFFER_SIZE 2048 // Upload bytes coalesced into one TLS write
+#define HTTP_UPLOAD_ATTEMPTS 3      // Attempts for an upload sent from a spooled file
+#define HTTP_MAX_HEADERS 10         // Caller headers sent with a request
+#define HTTP_HEADER_TIMEOUT 5000    // Time (ms) to wait for the response headers
+#define HTTP_BODY_TIMEOUT 2000      // Time (ms) without body bytes after which a response is considered stalled
+
+// Lets the HTTP core talk to the board's Arduino client
+class ClientStream : public HttpStream
+{
+public:
+#ifndef BOARD_BW16
+    ClientStream(WiFiClientSecure *client) : client(client) {}
+#else
+    ClientStream(WiFiSSLClient *client) : client(client) {}
+#endif
+    bool connect(const char *host, uint16_t port) override; // Retries without certificate checks if the secure connect fails
+    bool connected() override { return this->client->connected(); }
+    int available() override { return this->client->available(); }
+    int read(uint8_t *buffer, size_t size) override { return this->client->read(buffer, size); }
+    size_t write(const uint8_t *buffer, size_t size) override { return this->client->write(buffer, size); }
+    void stop() override { this->client->stop(); }
+    uint32_t millis() override { return ::millis(); }
+    void idle() override { delay(1); }
+
+private:
+#ifndef BOARD_BW16
+    WiFiClientSecure *client;
+#else
+    WiFiSSLClient *client;
+#endif
+};
 
 class HTTP
 {
@@ -22,21 +58,78 @@ public:
         String payload = "",                  // Payload to send with the request
         const char *headerKeys[] = nullptr,   // Array of header keys
         const char *headerValues[] = nullptr, // Array of header values
-        int headerSize = 0                    // Number of headers
+        int headerSize = 0,                   // Number of headers
+        JsonDocument *filter = nullptr        // ArduinoJson filter applied while reading a JSON response
     );
 
-    // Streams the response in chunks over UART, returns false if the request failed
-    bool stream(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize);
+    // Streams the response in chunks over UART, returns false if the request failed.
+    // offset/length request a byte range; resume reconnects and continues after a dropped connection.
+    // A body that still ends early is followed by an [ERROR] line with the bytes received before [GET/END]
+    bool stream(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize, size_t offset = 0, size_t length = 0, bool resume = false);
+
+    // Saves the response body (or the offset/length byte range of it) to path on the device's flash at WiFi speed,
+    // resuming after a dropped connection. Prints [FILE/STORED] with the stored size and remaining free space,
+    // returns false and removes the file if it failed, didn't fit or ended before the whole body arrived
+    bool download(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize, const char *path, size_t offset = 0, size_t length = 0);
+
+    // Streams the response through a compiled JSONPath, writing each match over UART as its own line.
+    // Returns false if the request failed
+    bool streamJsonPath(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize, JsonPath &path);
+
+    // Fetches up to size bytes of url starting at offset into buffer with a Range request over the shared connection.
+    // Returns the bytes stored, 0 if offset is past the end (416) or -1 on failure. total is set from Content-Range,
+    // or to 0 when the server doesn't know it ("bytes 0-1023/*"); a 200 is only accepted at offset 0 for a body that fits
+    int fetchRange(const String &url, const char *headerKeys[], const char *headerValues[], int headerSize, size_t offset, uint8_t *buffer, size_t size, size_t &total);
 
     // Reads fileSize raw bytes from UART and uploads them as the request body,
     // then streams the response back over UART. Returns false on failure.
-    bool streamUpload(const char *method, String url, size_t fileSize, String contentType, const char *headerKeys[], const char *headerValues[], int headerSize);
+    // A fileSize of 0 uploads with chunked encoding: the device sends "<length>\n" before each chunk and "0\n" to finish.
+    // A fileName wraps the bytes in a multipart/form-data part named fileField, preceded by the extra form fields.
+    // A sourcePath sends fileSize bytes from that spooled file instead of UART and retries if the upload fails
+    bool streamUpload(
+        const char *method,                   // HTTP method
+        String url,                           // URL to upload to
+        size_t fileSize,                      // Number of bytes the device will send, or 0 if unknown
+        String contentType,                   // Content type of the uploaded bytes
+        const char *headerKeys[],             // Array of header keys
+        const char *headerValues[],           // Array of header values
+        int headerSize,                       // Number of headers
+        const char *fieldKeys[] = nullptr,    // Array of multipart form field names
+        const char *fieldValues[] = nullptr,  // Array of multipart form field values
+        int fieldSize = 0,                    // Number of multipart form fields
+        const char *fileField = "file",       // Multipart field name of the file part
+        const char *fileName = nullptr,       // Multipart file name, nullptr for a raw body
+        const char *sourcePath = nullptr      // Spooled file to upload instead of reading UART
+    );
+
+    // Resolves each host and opens a TLS connection to the first https host so the next request to it skips the setup.
+    // Prints the result over UART and returns the number of hosts that resolved
+    int prewarm(const char *hosts[], int hostCount);
 
 private:
+    // Shared body of stream() and download(): writes the response to UART, or to sink (bounded by sinkLimit) when given
+    bool streamResponse(const char *method, String url, String payload, const char *headerKeys[], const char *headerValues[], int headerSize, size_t offset, size_t length, bool resume, Print *sink, size_t sinkLimit);
+    // Sends a request over the shared connection and reads the response headers into parser.
+    // A range adds a Range header. Returns the status code, -1 if the request failed, or -2 if it
+    // was refused before sending (bad URL, too many headers), in which case the error is already printed
+    int sendRequest(const char *method, const String &url, const String &payload, const char *headerKeys[], const char *headerValues[], int headerSize, const char *range, HttpResponseParser &parser);
+    // Reads the response body through the filter and returns the projected JSON
+    String filterResponse(HttpResponseParser &parser, JsonDocument &filter);
 #ifndef BOARD_BW16
     WiFiClientSecure *client; // WiFiClientSecure object for secure connections
 #else
     WiFiSSLClient *client; // WiFiSSLClient object for secure connections
 #endif
-    UART *uart; // UART object to handle serial communication
+    // Copies length raw bytes from UART (or source) to the open connection, returns false if the data stops
+    bool pipeUpload(size_t length, Stream *source = nullptr);
+    void beginWrites();                                // Allocates the write buffer for an upload
+    void queueWrite(const uint8_t *data, size_t size); // Appends to the write buffer, sending it when full
+    void queueWrite(const String &data);               // Appends a string to the write buffer
+    bool flushWrites();                                // Sends the buffered bytes, returns false if the connection failed
+    void endWrites();                                  // Frees the write buffer
+    uint8_t *writeBuffer;      // Coalesced upload bytes, only allocated during an upload
+    size_t writeLength;        // Number of bytes in writeBuffer
+    UART *uart;                // UART object to handle serial communication
+    ClientStream clientStream; // The client as seen by the HTTP core
+    HttpConnection connection; // HTTP core connection over clientStream
 };
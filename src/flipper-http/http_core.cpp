@@ -0,0 +1,591 @@
+#include "http_core.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char lowerCase(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static bool equalsIgnoreCase(const char *a, const char *b)
+{
+    while (*a && *b)
+    {
+        if (lowerCase(*a++) != lowerCase(*b++))
+        {
+            return false;
+        }
+    }
+    return *a == *b;
+}
+
+static bool containsIgnoreCase(const char *text, const char *word)
+{
+    size_t wordLength = strlen(word);
+    for (; *text; text++)
+    {
+        size_t i = 0;
+        while (i < wordLength && text[i] && lowerCase(text[i]) == lowerCase(word[i]))
+        {
+            i++;
+        }
+        if (i == wordLength)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Appends text when it fits, but always counts it, so a null buffer measures the head
+static void appendText(char *buffer, size_t size, size_t &used, const char *text)
+{
+    size_t length = strlen(text);
+    if (buffer && used + length < size)
+    {
+        memcpy(buffer + used, text, length);
+        buffer[used + length] = '\0';
+    }
+    used += length;
+}
+
+bool httpSplitUrl(const char *url, char *host, size_t hostSize, uint16_t *port, const char **path, bool *secure)
+{
+    *secure = true;
+    *port = 443;
+    if (strncmp(url, "https://", 8) == 0)
+    {
+        url += 8;
+    }
+    else if (strncmp(url, "http://", 7) == 0)
+    {
+        url += 7;
+        *secure = false;
+        *port = 80;
+    }
+    else if (strncmp(url, "wss://", 6) == 0)
+    {
+        url += 6;
+    }
+    else if (strncmp(url, "ws://", 5) == 0)
+    {
+        url += 5;
+        *secure = false;
+        *port = 80;
+    }
+
+    const char *end = url;
+    while (*end && *end != '/')
+    {
+        end++;
+    }
+    const char *hostEnd = (const char *)memchr(url, ':', end - url);
+    if (hostEnd)
+    {
+        *port = (uint16_t)strtoul(hostEnd + 1, nullptr, 10);
+    }
+    else
+    {
+        hostEnd = end;
+    }
+
+    size_t hostLength = hostEnd - url;
+    if (hostLength == 0 || hostLength >= hostSize)
+    {
+        return false;
+    }
+    memcpy(host, url, hostLength);
+    host[hostLength] = '\0';
+    *path = *end ? end : "/";
+    return true;
+}
+
+// Writes the head into buffer as far as it fits and returns its full length
+static size_t composeRequestHead(char *buffer, size_t size, const char *method, const char *host, uint16_t port, const char *path, const char *headerKeys[], const char *headerValues[], int headerSize, long contentLength, bool keepAlive)
+{
+    size_t used = 0;
+    char number[32];
+
+    appendText(buffer, size, used, method);
+    appendText(buffer, size, used, " ");
+    appendText(buffer, size, used, path[0] ? path : "/");
+    appendText(buffer, size, used, " HTTP/1.1\r\nHost: ");
+    appendText(buffer, size, used, host);
+    if (port != 80 && port != 443)
+    {
+        snprintf(number, sizeof(number), ":%u", (unsigned)port);
+        appendText(buffer, size, used, number);
+    }
+    appendText(buffer, size, used, "\r\n");
+    for (int i = 0; i < headerSize; i++)
+    {
+        appendText(buffer, size, used, headerKeys[i]);
+        appendText(buffer, size, used, ": ");
+        appendText(buffer, size, used, headerValues[i]);
+        appendText(buffer, size, used, "\r\n");
+    }
+    if (contentLength >= 0)
+    {
+        snprintf(number, sizeof(number), "%ld", contentLength);
+        appendText(buffer, size, used, "Content-Length: ");
+        appendText(buffer, size, used, number);
+        appendText(buffer, size, used, "\r\n");
+    }
+    else if (contentLength == -1)
+    {
+        appendText(buffer, size, used, "Transfer-Encoding: chunked\r\n");
+    }
+    if (!keepAlive)
+    {
+        appendText(buffer, size, used, "Connection: close\r\n");
+    }
+    appendText(buffer, size, used, "\r\n"); // blank line ends headers
+    return used;
+}
+
+size_t httpWriteRequestHead(char *buffer, size_t size, const char *method, const char *host, uint16_t port, const char *path, const char *headerKeys[], const char *headerValues[], int headerSize, long contentLength, bool keepAlive)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+    buffer[0] = '\0';
+    size_t length = composeRequestHead(buffer, size, method, host, port, path, headerKeys, headerValues, headerSize, contentLength, keepAlive);
+    return length < size ? length : 0;
+}
+
+char *httpNewRequestHead(size_t &length, const char *method, const char *host, uint16_t port, const char *path, const char *headerKeys[], const char *headerValues[], int headerSize, long contentLength, bool keepAlive)
+{
+    length = composeRequestHead(nullptr, 0, method, host, port, path, headerKeys, headerValues, headerSize, contentLength, keepAlive);
+    char *head = (char *)malloc(length + 1);
+    if (head)
+    {
+        composeRequestHead(head, length + 1, method, host, port, path, headerKeys, headerValues, headerSize, contentLength, keepAlive);
+    }
+    return head;
+}
+
+size_t httpWriteChunkHeader(char *buffer, size_t size, size_t length)
+{
+    int written = snprintf(buffer, size, "%lx\r\n", (unsigned long)length);
+    return (written > 0 && (size_t)written < size) ? (size_t)written : 0;
+}
+
+HttpResponseParser::HttpResponseParser()
+{
+    this->headerCallback = nullptr;
+    this->headerContext = nullptr;
+    this->reset();
+}
+
+void HttpResponseParser::reset(bool headRequest)
+{
+    this->state = STATE_STATUS;
+    this->lineLength = 0;
+    this->statusCode = 0;
+    this->length = -1;
+    this->remaining = 0;
+    this->isChunked = false;
+    this->isKeepAlive = true;
+    this->headRequest = headRequest;
+}
+
+void HttpResponseParser::onHeader(HeaderCallback callback, void *context)
+{
+    this->headerCallback = callback;
+    this->headerContext = context;
+}
+
+bool HttpResponseParser::appendLine(uint8_t c)
+{
+    if (c == '\n')
+    {
+        this->line[this->lineLength] = '\0';
+        this->lineLength = 0;
+        return true;
+    }
+    if (c != '\r' && this->lineLength < sizeof(this->line) - 1)
+    {
+        this->line[this->lineLength++] = (char)c;
+    }
+    return false;
+}
+
+void HttpResponseParser::handleStatusLine()
+{
+    // "HTTP/1.1 200 OK"
+    if (strncmp(this->line, "HTTP/", 5) != 0)
+    {
+        this->state = STATE_ERROR;
+        return;
+    }
+    const char *space = strchr(this->line, ' ');
+    if (!space)
+    {
+        this->state = STATE_ERROR;
+        return;
+    }
+    this->statusCode = atoi(space + 1);
+    this->isKeepAlive = strncmp(this->line + 5, "1.0", 3) != 0; // HTTP/1.0 closes unless told otherwise
+    this->state = STATE_HEADER;
+}
+
+void HttpResponseParser::handleHeaderLine()
+{
+    if (this->line[0] == '\0')
+    {
+        // Blank line: the headers are complete, pick how the body ends
+        if (this->statusCode >= 100 && this->statusCode < 200)
+        {
+            // Interim response such as 100 Continue, the real one follows
+            bool headRequest = this->headRequest;
+            this->reset(headRequest);
+        }
+        else if (this->headRequest || this->statusCode == 204 || this->statusCode == 304)
+        {
+            this->state = STATE_DONE;
+        }
+        else if (this->isChunked)
+        {
+            this->state = STATE_CHUNK_SIZE;
+        }
+        else if (this->length >= 0)
+        {
+            this->remaining = (unsigned long)this->length;
+            this->state = this->remaining > 0 ? STATE_BODY : STATE_DONE;
+        }
+        else
+        {
+            this->isKeepAlive = false;
+            this->state = STATE_BODY_UNTIL_CLOSE;
+        }
+        return;
+    }
+
+    char *colon = strchr(this->line, ':');
+    if (!colon)
+    {
+        return; // not a header, ignore it
+    }
+    char *nameEnd = colon;
+    while (nameEnd > this->line && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t'))
+    {
+        nameEnd--;
+    }
+    *nameEnd = '\0';
+    char *value = colon + 1;
+    while (*value == ' ' || *value == '\t')
+    {
+        value++;
+    }
+    char *valueEnd = value + strlen(value);
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+    {
+        *--valueEnd = '\0';
+    }
+
+    if (equalsIgnoreCase(this->line, "Content-Length"))
+    {
+        this->length = strtol(value, nullptr, 10);
+    }
+    else if (equalsIgnoreCase(this->line, "Transfer-Encoding"))
+    {
+        this->isChunked = containsIgnoreCase(value, "chunked");
+    }
+    else if (equalsIgnoreCase(this->line, "Connection"))
+    {
+        if (containsIgnoreCase(value, "close"))
+        {
+            this->isKeepAlive = false;
+        }
+        else if (containsIgnoreCase(value, "keep-alive"))
+        {
+            this->isKeepAlive = true;
+        }
+    }
+    if (this->headerCallback)
+    {
+        this->headerCallback(this->headerContext, this->line, value);
+    }
+}
+
+void HttpResponseParser::handleChunkSizeLine()
+{
+    // "1a2b" optionally followed by ";extension"
+    char *end = nullptr;
+    unsigned long size = strtoul(this->line, &end, 16);
+    if (end == this->line)
+    {
+        this->state = STATE_ERROR;
+        return;
+    }
+    if (size == 0)
+    {
+        this->state = STATE_TRAILER;
+        return;
+    }
+    this->remaining = size;
+    this->state = STATE_CHUNK_DATA;
+}
+
+size_t HttpResponseParser::feed(const uint8_t *data, size_t size, size_t &bodyOffset, size_t &bodyLength)
+{
+    bodyOffset = 0;
+    bodyLength = 0;
+    size_t i = 0;
+    while (i < size)
+    {
+        switch (this->state)
+        {
+        case STATE_STATUS:
+            if (this->appendLine(data[i++]))
+            {
+                this->handleStatusLine();
+            }
+            break;
+        case STATE_HEADER:
+            if (this->appendLine(data[i++]))
+            {
+                this->handleHeaderLine();
+                if (this->headersComplete())
+                {
+                    return i; // let the caller look at the headers before the body
+                }
+            }
+            break;
+        case STATE_BODY:
+        case STATE_CHUNK_DATA:
+        {
+            size_t count = size - i;
+            if (count > this->remaining)
+            {
+                count = this->remaining;
+            }
+            bodyOffset = i;
+            bodyLength = count;
+            this->remaining -= count;
+            if (this->remaining == 0)
+            {
+                this->state = this->state == STATE_BODY ? STATE_DONE : STATE_CHUNK_END;
+            }
+            return i + count;
+        }
+        case STATE_BODY_UNTIL_CLOSE:
+            bodyOffset = i;
+            bodyLength = size - i;
+            return size;
+        case STATE_CHUNK_SIZE:
+            if (this->appendLine(data[i++]))
+            {
+                this->handleChunkSizeLine();
+            }
+            break;
+        case STATE_CHUNK_END:
+            if (this->appendLine(data[i++]))
+            {
+                this->state = STATE_CHUNK_SIZE;
+            }
+            break;
+        case STATE_TRAILER:
+            if (this->appendLine(data[i++]) && this->line[0] == '\0')
+            {
+                this->state = STATE_DONE;
+            }
+            break;
+        case STATE_DONE:
+        case STATE_ERROR:
+            return i;
+        }
+    }
+    return i;
+}
+
+void HttpResponseParser::finish()
+{
+    if (this->state == STATE_BODY_UNTIL_CLOSE)
+    {
+        this->state = STATE_DONE;
+    }
+    else if (this->state != STATE_DONE)
+    {
+        this->state = STATE_ERROR; // closed before the response was complete
+    }
+}
+
+HttpConnection::HttpConnection(HttpStream *stream)
+{
+    this->stream = stream;
+    this->host[0] = '\0';
+    this->port = 0;
+    this->reused = false;
+    this->lastUsed = 0;
+    this->received = 0;
+    this->receivePosition = 0;
+    this->receiveLength = 0;
+}
+
+bool HttpConnection::open(const char *host, uint16_t port)
+{
+    uint32_t now = this->stream->millis();
+    this->reused = this->host[0] != '\0' && this->port == port && strcmp(this->host, host) == 0 &&
+                   now - this->lastUsed <= HTTP_CORE_IDLE_TIMEOUT && this->stream->connected();
+    if (this->reused)
+    {
+        this->lastUsed = now;
+        return true;
+    }
+    this->close();
+    if (strlen(host) >= sizeof(this->host) || !this->stream->connect(host, port))
+    {
+        return false;
+    }
+    strcpy(this->host, host);
+    this->port = port;
+    this->lastUsed = this->stream->millis();
+    return true;
+}
+
+bool HttpConnection::send(const uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        size_t written = this->stream->write(data, size);
+        if (written == 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool HttpConnection::send(const char *text)
+{
+    return this->send((const uint8_t *)text, strlen(text));
+}
+
+bool HttpConnection::fill(uint32_t timeout)
+{
+    uint32_t start = this->stream->millis();
+    while (true)
+    {
+        int available = this->stream->available();
+        if (available > 0)
+        {
+            size_t size = (size_t)available < sizeof(this->receive) ? (size_t)available : sizeof(this->receive);
+            int count = this->stream->read(this->receive, size);
+            if (count > 0)
+            {
+                this->received += (size_t)count;
+                this->receivePosition = 0;
+                this->receiveLength = (size_t)count;
+                return true;
+            }
+        }
+        if (!this->stream->connected() || this->stream->millis() - start > timeout)
+        {
+            return false;
+        }
+        this->stream->idle();
+    }
+}
+
+int HttpConnection::readHeaders(HttpResponseParser &parser, uint32_t timeout)
+{
+    while (!parser.failed() && !parser.headersComplete())
+    {
+        if (this->receivePosition == this->receiveLength && !this->fill(timeout))
+        {
+            return -1;
+        }
+        size_t bodyOffset, bodyLength;
+        this->receivePosition += parser.feed(this->receive + this->receivePosition, this->receiveLength - this->receivePosition, bodyOffset, bodyLength);
+    }
+    return parser.failed() ? -1 : parser.status();
+}
+
+int HttpConnection::readBody(HttpResponseParser &parser, const uint8_t *&data, uint32_t timeout)
+{
+    while (true)
+    {
+        if (parser.done())
+        {
+            return 0;
+        }
+        if (parser.failed())
+        {
+            return -1;
+        }
+        if (this->receivePosition == this->receiveLength && !this->fill(timeout))
+        {
+            if (!this->stream->connected())
+            {
+                parser.finish();
+                if (parser.done())
+                {
+                    return 0;
+                }
+            }
+            return -1;
+        }
+        size_t bodyOffset, bodyLength;
+        const uint8_t *start = this->receive + this->receivePosition;
+        this->receivePosition += parser.feed(start, this->receiveLength - this->receivePosition, bodyOffset, bodyLength);
+        if (bodyLength > 0)
+        {
+            data = start + bodyOffset;
+            return (int)bodyLength;
+        }
+    }
+}
+
+int HttpConnection::request(const char *host, uint16_t port, const uint8_t *head, size_t headLength, const uint8_t *body, size_t bodyLength, HttpResponseParser &parser, uint32_t timeout)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (!this->open(host, port))
+        {
+            return -1;
+        }
+        bool reused = this->reused;
+        this->received = 0;
+        int status = -1;
+        bool sent = this->send(head, headLength) && this->send(body, bodyLength);
+        if (sent)
+        {
+            status = this->readHeaders(parser, timeout);
+        }
+        if (status >= 0)
+        {
+            return status;
+        }
+        bool closed = !sent || !this->stream->connected();
+        this->close();
+        if (!reused || !closed || this->received > 0)
+        {
+            break; // a new connection failed, the server is slow (it may have acted on the request), or it answered something unusable
+        }
+    }
+    return -1;
+}
+
+void HttpConnection::end(HttpResponseParser &parser)
+{
+    // Only a fully read response on a keep-alive connection leaves it reusable
+    if (!parser.done() || !parser.keepAlive() || this->receivePosition != this->receiveLength)
+    {
+        this->close();
+        return;
+    }
+    this->lastUsed = this->stream->millis();
+}
+
+void HttpConnection::close()
+{
+    this->stream->stop();
+    this->host[0] = '\0';
+    this->receivePosition = 0;
+    this->receiveLength = 0;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Board-independent HTTP/1.1 client core. It only uses the C library, so it
+// builds for every board and with a desktop compiler against a local server.
+
+#define HTTP_CORE_LINE_SIZE 256      // Longest status or header line kept, longer lines are truncated
+#define HTTP_CORE_HOST_SIZE 256      // Longest host name kept for connection reuse (DNS names are at most 253 characters)
+#define HTTP_CORE_RECEIVE_SIZE 512   // Bytes read from the stream at once
+#define HTTP_CORE_IDLE_TIMEOUT 10000 // Idle time (ms) after which a kept-alive connection is not reused
+
+// Byte stream the core talks to: a TLS/TCP client on the boards, a socket on a desktop
+class HttpStream
+{
+public:
+    virtual ~HttpStream() {}
+    virtual bool connect(const char *host, uint16_t port) = 0;
+    virtual bool connected() = 0;
+    virtual int available() = 0;
+    virtual int read(uint8_t *buffer, size_t size) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    virtual void stop() = 0;
+    virtual uint32_t millis() = 0; // Monotonic clock used for timeouts
+    virtual void idle() {}         // Called while waiting for data
+};
+
+// Splits "https://host:port/path" (or http://, ws://, wss://) into its parts. Returns false if the host doesn't fit
+bool httpSplitUrl(const char *url, char *host, size_t hostSize, uint16_t *port, const char **path, bool *secure);
+
+// Writes the request line and headers into buffer. The Host header carries the port unless it is 80 or 443.
+// A contentLength of -1 sends Transfer-Encoding: chunked, -2 sends no body headers. Returns the length, or 0 if it doesn't fit
+size_t httpWriteRequestHead(char *buffer, size_t size, const char *method, const char *host, uint16_t port, const char *path, const char *headerKeys[], const char *headerValues[], int headerSize, long contentLength, bool keepAlive);
+
+// Same head in a buffer malloc'd to fit it, so long headers (tokens, cookies) have no fixed limit.
+// Sets length and returns the head, which the caller frees, or nullptr when out of memory
+char *httpNewRequestHead(size_t &length, const char *method, const char *host, uint16_t port, const char *path, const char *headerKeys[], const char *headerValues[], int headerSize, long contentLength, bool keepAlive);
+
+// Writes the "<hex length>\r\n" that starts a chunk, returns its length
+size_t httpWriteChunkHeader(char *buffer, size_t size, size_t length);
+
+// Incremental HTTP/1.1 response parser. Feed it bytes as they arrive: it
+// handles lines split across reads and removes chunked framing from the body.
+class HttpResponseParser
+{
+public:
+    typedef void (*HeaderCallback)(void *context, const char *name, const char *value);
+
+    HttpResponseParser();
+
+    void reset(bool headRequest = false);                                                  // Prepares for the next response (HEAD responses have no body)
+    void onHeader(HeaderCallback callback, void *context);                                 // Called for every header line, name and value are only valid during the call
+    size_t feed(const uint8_t *data, size_t size, size_t &bodyOffset, size_t &bodyLength); // Consumes bytes, stopping after the first body span found in them
+    void finish();                                                                         // The connection closed, which ends a body without a length
+
+    bool headersComplete() const { return this->state >= STATE_BODY; }
+    bool done() const { return this->state == STATE_DONE; }
+    bool failed() const { return this->state == STATE_ERROR; }
+    int status() const { return this->statusCode; }
+    long contentLength() const { return this->length; } // -1 when not given
+    bool chunked() const { return this->isChunked; }
+    bool keepAlive() const { return this->isKeepAlive; }
+
+private:
+    enum State
+    {
+        STATE_STATUS,           // Reading the status line
+        STATE_HEADER,           // Reading header lines
+        STATE_BODY,             // Body with a known length
+        STATE_BODY_UNTIL_CLOSE, // Body that ends when the connection closes
+        STATE_CHUNK_SIZE,       // Reading a chunk size line
+        STATE_CHUNK_DATA,       // Inside a chunk
+        STATE_CHUNK_END,        // Reading the CRLF after a chunk
+        STATE_TRAILER,          // Reading trailer lines after the last chunk
+        STATE_DONE,             // The response is complete
+        STATE_ERROR,            // The response is malformed
+    };
+
+    bool appendLine(uint8_t c); // Adds a byte to the line buffer, returns true when a line ended
+    void handleStatusLine();    // Parses the status line in the line buffer
+    void handleHeaderLine();    // Parses a header line or the blank line ending the headers
+    void handleChunkSizeLine(); // Parses a chunk size line
+
+    State state;                    // Current parser state
+    char line[HTTP_CORE_LINE_SIZE]; // Current line, without CR/LF
+    size_t lineLength;              // Number of bytes in line
+    int statusCode;                 // Response status code
+    long length;                    // Content-Length, or -1
+    unsigned long remaining;        // Body or chunk bytes still to come
+    bool isChunked;                 // Transfer-Encoding: chunked
+    bool isKeepAlive;               // Whether the connection can be reused afterwards
+    bool headRequest;               // Whether the request was HEAD
+    HeaderCallback headerCallback;  // Optional header callback
+    void *headerContext;            // Context passed to headerCallback
+};
+
+// A request/response exchange over an HttpStream, keeping the connection open between requests to the same host
+class HttpConnection
+{
+public:
+    HttpConnection(HttpStream *stream);
+
+    bool open(const char *host, uint16_t port);                                       // Connects, or reuses the open connection to the same host if it wasn't idle too long
+    bool send(const uint8_t *data, size_t size);                                      // Writes request bytes, returns false if the connection failed
+    bool send(const char *text);                                                      // Writes a null-terminated string
+    int readHeaders(HttpResponseParser &parser, uint32_t timeout);                    // Waits for the response headers, returns the status or -1
+    int readBody(HttpResponseParser &parser, const uint8_t *&data, uint32_t timeout); // Points data at the next body bytes; 0 at the end, -1 on timeout or error
+
+    // Opens the connection, sends head and body and waits for the response headers. Returns the status or -1.
+    // A reused connection the server closed while idle fails before any response byte, so it's retried once on a new one.
+    // A timeout is never retried, the server may still be handling the request
+    int request(const char *host, uint16_t port, const uint8_t *head, size_t headLength, const uint8_t *body, size_t bodyLength, HttpResponseParser &parser, uint32_t timeout);
+
+    void end(HttpResponseParser &parser);                                             // Closes the connection unless it can be reused
+    void close();                                                                     // Always closes the connection
+
+private:
+    bool fill(uint32_t timeout); // Reads more bytes, returns false on timeout or close
+
+    HttpStream *stream;                      // Underlying byte stream
+    char host[HTTP_CORE_HOST_SIZE];          // Host of the open connection, empty if none
+    uint16_t port;                           // Port of the open connection
+    bool reused;                             // Whether the last open() kept the existing connection
+    uint32_t lastUsed;                       // millis() when the connection was last opened or released
+    size_t received;                         // Bytes read since request() sent the request
+    uint8_t receive[HTTP_CORE_RECEIVE_SIZE]; // Bytes read but not parsed yet
+    size_t receivePosition;                  // Next unparsed byte in receive
+    size_t receiveLength;                    // Number of bytes in receive
+};
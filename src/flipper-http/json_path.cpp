@@ -0,0 +1,409 @@
+#include "json_path.hpp"
+
+static bool isJsonWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+JsonPath::JsonPath(UART *uart)
+{
+    this->uart = uart;
+    this->segmentCount = 0;
+    this->hasWildcard = false;
+    this->reset();
+}
+
+bool JsonPath::compile(const char *path)
+{
+    this->segmentCount = 0;
+    this->hasWildcard = false;
+    this->reset();
+
+    if (!path || *path != '$')
+    {
+        return false;
+    }
+    path++;
+
+    while (*path)
+    {
+        if (this->segmentCount >= JSON_PATH_MAX_SEGMENTS)
+        {
+            return false;
+        }
+        Segment &segment = this->segments[this->segmentCount];
+        segment.index = 0;
+        segment.key[0] = '\0';
+
+        if (*path == '.')
+        {
+            path++;
+            if (*path == '*')
+            {
+                segment.type = SEGMENT_WILDCARD;
+                path++;
+            }
+            else
+            {
+                // .key runs until the next selector
+                size_t len = 0;
+                while (*path && *path != '.' && *path != '[')
+                {
+                    if (len >= JSON_PATH_MAX_KEY - 1)
+                    {
+                        return false;
+                    }
+                    segment.key[len++] = *path++;
+                }
+                if (len == 0)
+                {
+                    return false;
+                }
+                segment.key[len] = '\0';
+                segment.type = SEGMENT_KEY;
+            }
+        }
+        else if (*path == '[')
+        {
+            path++;
+            if (*path == '*')
+            {
+                segment.type = SEGMENT_WILDCARD;
+                path++;
+            }
+            else if (*path == '\'' || *path == '"')
+            {
+                // ['key'] or ["key"]
+                char quote = *path++;
+                size_t len = 0;
+                while (*path && *path != quote)
+                {
+                    if (len >= JSON_PATH_MAX_KEY - 1)
+                    {
+                        return false;
+                    }
+                    segment.key[len++] = *path++;
+                }
+                if (*path != quote)
+                {
+                    return false;
+                }
+                path++;
+                segment.key[len] = '\0';
+                segment.type = SEGMENT_KEY;
+            }
+            else if (*path >= '0' && *path <= '9')
+            {
+                while (*path >= '0' && *path <= '9')
+                {
+                    segment.index = segment.index * 10 + (*path - '0');
+                    path++;
+                }
+                segment.type = SEGMENT_INDEX;
+            }
+            else
+            {
+                return false;
+            }
+            if (*path != ']')
+            {
+                return false;
+            }
+            path++;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (segment.type == SEGMENT_WILDCARD)
+        {
+            this->hasWildcard = true;
+        }
+        this->segmentCount++;
+    }
+    return true;
+}
+
+void JsonPath::reset()
+{
+    this->state = STATE_VALUE;
+    this->depth = 0;
+    this->matched[0] = true;
+    this->keyPos = 0;
+    this->keyMatches = false;
+    this->skipDepth = 0;
+    this->emitting = false;
+    this->matchCount = 0;
+    this->outputLength = 0;
+}
+
+void JsonPath::feed(const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size && !this->done(); i++)
+    {
+        this->process((char)data[i]);
+    }
+}
+
+bool JsonPath::done() const
+{
+    // Without a wildcard the path can match at most one value
+    return this->state == STATE_DONE || this->state == STATE_ERROR || (!this->hasWildcard && this->matchCount > 0);
+}
+
+bool JsonPath::failed() const
+{
+    return this->state == STATE_ERROR;
+}
+
+bool JsonPath::selectorMatches(int level)
+{
+    // level is the child's level, its parent container is depth level - 1
+    const Segment &segment = this->segments[level - 1];
+    if (segment.type == SEGMENT_WILDCARD)
+    {
+        return true;
+    }
+    if (this->containerType[level - 1] == '[')
+    {
+        return segment.type == SEGMENT_INDEX && segment.index == this->childIndex[level - 1];
+    }
+    return segment.type == SEGMENT_KEY && this->keyMatches;
+}
+
+void JsonPath::beginValue(char c)
+{
+    int level = this->depth;
+    bool match = level == 0 || (this->matched[level - 1] && this->selectorMatches(level));
+    this->matched[level] = match;
+
+    if (match && level < this->segmentCount && (c == '{' || c == '['))
+    {
+        // Follow the container, its children are compared against the next segment
+        this->containerType[level] = c;
+        this->childIndex[level] = 0;
+        this->depth++;
+        this->state = c == '{' ? STATE_OBJECT_START : STATE_ARRAY_START;
+        return;
+    }
+
+    // Anything else is either the match itself or skipped as a whole
+    this->emitting = match && level == this->segmentCount;
+    this->output(c);
+    if (c == '{' || c == '[')
+    {
+        this->skipDepth = 1;
+        this->state = STATE_SKIP;
+    }
+    else if (c == '"')
+    {
+        this->skipDepth = 0;
+        this->state = STATE_SKIP_STRING;
+    }
+    else if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n')
+    {
+        this->state = STATE_LITERAL;
+    }
+    else
+    {
+        this->state = STATE_ERROR;
+    }
+}
+
+void JsonPath::endValue()
+{
+    if (this->emitting)
+    {
+        this->flushOutput();
+        this->uart->println();
+        this->emitting = false;
+        this->matchCount++;
+    }
+    this->state = this->depth == 0 ? STATE_DONE : STATE_AFTER_VALUE;
+}
+
+void JsonPath::output(char c)
+{
+    if (!this->emitting)
+    {
+        return;
+    }
+    if (this->outputLength >= sizeof(this->outputBuffer))
+    {
+        this->flushOutput();
+    }
+    this->outputBuffer[this->outputLength++] = c;
+}
+
+void JsonPath::flushOutput()
+{
+    if (this->outputLength > 0)
+    {
+        this->uart->write((const uint8_t *)this->outputBuffer, this->outputLength);
+        this->outputLength = 0;
+    }
+}
+
+void JsonPath::process(char c)
+{
+    switch (this->state)
+    {
+    case STATE_VALUE:
+        if (!isJsonWhitespace(c))
+        {
+            this->beginValue(c);
+        }
+        break;
+    case STATE_ARRAY_START:
+        if (c == ']')
+        {
+            this->depth--;
+            this->endValue();
+        }
+        else if (!isJsonWhitespace(c))
+        {
+            this->beginValue(c);
+        }
+        break;
+    case STATE_OBJECT_START:
+    case STATE_KEY_START:
+        if (c == '"')
+        {
+            this->keyPos = 0;
+            this->keyMatches = true;
+            this->state = STATE_KEY;
+        }
+        else if (c == '}' && this->state == STATE_OBJECT_START)
+        {
+            this->depth--;
+            this->endValue();
+        }
+        else if (!isJsonWhitespace(c))
+        {
+            this->state = STATE_ERROR;
+        }
+        break;
+    case STATE_KEY:
+    {
+        const Segment &segment = this->segments[this->depth - 1];
+        if (c == '"')
+        {
+            this->keyMatches = this->keyMatches && this->keyPos < JSON_PATH_MAX_KEY && segment.key[this->keyPos] == '\0';
+            this->state = STATE_COLON;
+        }
+        else
+        {
+            if (c == '\\')
+            {
+                // Escaped keys are compared literally, so they never match a plain selector
+                this->keyMatches = false;
+                this->state = STATE_KEY_ESCAPE;
+            }
+            else if (this->keyMatches)
+            {
+                this->keyMatches = this->keyPos < JSON_PATH_MAX_KEY - 1 && segment.key[this->keyPos] == c;
+            }
+            this->keyPos++;
+        }
+        break;
+    }
+    case STATE_KEY_ESCAPE:
+        this->state = STATE_KEY;
+        break;
+    case STATE_COLON:
+        if (c == ':')
+        {
+            this->state = STATE_VALUE;
+        }
+        else if (!isJsonWhitespace(c))
+        {
+            this->state = STATE_ERROR;
+        }
+        break;
+    case STATE_AFTER_VALUE:
+        if (c == ',')
+        {
+            if (this->containerType[this->depth - 1] == '[')
+            {
+                this->childIndex[this->depth - 1]++;
+                this->state = STATE_VALUE;
+            }
+            else
+            {
+                this->state = STATE_KEY_START;
+            }
+        }
+        else if ((c == '}' && this->containerType[this->depth - 1] == '{') || (c == ']' && this->containerType[this->depth - 1] == '['))
+        {
+            this->depth--;
+            this->endValue();
+        }
+        else if (!isJsonWhitespace(c))
+        {
+            this->state = STATE_ERROR;
+        }
+        break;
+    case STATE_SKIP:
+        if (isJsonWhitespace(c))
+        {
+            break; // matches are written compact
+        }
+        this->output(c);
+        if (c == '"')
+        {
+            this->state = STATE_SKIP_STRING;
+        }
+        else if (c == '{' || c == '[')
+        {
+            this->skipDepth++;
+        }
+        else if (c == '}' || c == ']')
+        {
+            if (--this->skipDepth == 0)
+            {
+                this->endValue();
+            }
+        }
+        break;
+    case STATE_SKIP_STRING:
+        this->output(c);
+        if (c == '\\')
+        {
+            this->state = STATE_SKIP_ESCAPE;
+        }
+        else if (c == '"')
+        {
+            if (this->skipDepth == 0)
+            {
+                this->endValue();
+            }
+            else
+            {
+                this->state = STATE_SKIP;
+            }
+        }
+        break;
+    case STATE_SKIP_ESCAPE:
+        this->output(c);
+        this->state = STATE_SKIP_STRING;
+        break;
+    case STATE_LITERAL:
+        if (c == ',' || c == '}' || c == ']' || isJsonWhitespace(c))
+        {
+            this->endValue();
+            if (this->state == STATE_AFTER_VALUE)
+            {
+                this->process(c); // the delimiter belongs to the container
+            }
+        }
+        else
+        {
+            this->output(c);
+        }
+        break;
+    case STATE_DONE:
+    case STATE_ERROR:
+        break;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+#include "uart.hpp"
+
+#define JSON_PATH_MAX_SEGMENTS 8 // Maximum number of selectors after '$'
+#define JSON_PATH_MAX_KEY 32     // Maximum key length in a selector (including null terminator)
+#define JSON_PATH_OUTPUT_SIZE 64 // Bytes buffered before a match is written over UART
+
+// Evaluates a small JSONPath subset on a JSON stream with constant memory.
+// Supported selectors: $, .key, ['key'], [n], [*] and .*
+// Each match is written over UART as one compact line as soon as it ends.
+class JsonPath
+{
+public:
+    JsonPath(UART *uart);
+
+    bool compile(const char *path);                     // Parses the path, returns false if it is not supported
+    void feed(const uint8_t *data, size_t size);        // Feeds the next chunk of the JSON document
+    bool done() const;                                  // True when no further matches are possible
+    bool failed() const;                                // True when the document was not valid JSON
+    size_t matches() const { return this->matchCount; } // Number of matches written so far
+    void reset();                                       // Restarts parsing for a new document with the same path
+
+private:
+    enum SegmentType
+    {
+        SEGMENT_KEY,      // .key or ['key']
+        SEGMENT_INDEX,    // [n]
+        SEGMENT_WILDCARD, // [*] or .*
+    };
+
+    struct Segment
+    {
+        SegmentType type;
+        uint32_t index;              // Array index for SEGMENT_INDEX
+        char key[JSON_PATH_MAX_KEY]; // Object key for SEGMENT_KEY
+    };
+
+    enum State
+    {
+        STATE_VALUE,        // Expecting a value
+        STATE_OBJECT_START, // After '{', expecting a key or '}'
+        STATE_KEY_START,    // After ',' in an object, expecting a key
+        STATE_KEY,          // Inside an object key
+        STATE_KEY_ESCAPE,   // After '\' in an object key
+        STATE_COLON,        // After a key, expecting ':'
+        STATE_ARRAY_START,  // After '[', expecting a value or ']'
+        STATE_AFTER_VALUE,  // Expecting ',' or the end of the container
+        STATE_SKIP,         // Inside a container that is skipped or emitted as a whole
+        STATE_SKIP_STRING,  // Inside a string that is skipped or emitted
+        STATE_SKIP_ESCAPE,  // After '\' in a skipped or emitted string
+        STATE_LITERAL,      // Inside a number, true, false or null
+        STATE_DONE,         // The root value ended
+        STATE_ERROR,        // Invalid JSON
+    };
+
+    void process(char c);            // Advances the parser by one character
+    void beginValue(char c);         // Handles the first character of a value
+    void endValue();                 // Finishes the current value
+    void output(char c);             // Buffers one character of the current match
+    void flushOutput();              // Writes buffered match bytes over UART
+    bool selectorMatches(int level); // Whether the current child at level matches its segment
+
+    UART *uart;                                  // UART object to handle serial communication
+    Segment segments[JSON_PATH_MAX_SEGMENTS];    // Compiled selectors
+    int segmentCount;                            // Number of compiled selectors
+    bool hasWildcard;                            // Whether more than one match is possible
+    State state;                                 // Current parser state
+    int depth;                                   // Containers opened on the path being followed
+    char containerType[JSON_PATH_MAX_SEGMENTS];  // '{' or '[' for each followed container
+    uint32_t childIndex[JSON_PATH_MAX_SEGMENTS]; // Index of the current child in each followed array
+    bool matched[JSON_PATH_MAX_SEGMENTS + 1];    // Whether the path matches down to each level
+    size_t keyPos;                               // Characters of the current key compared so far
+    bool keyMatches;                             // Whether the current key matches its segment so far
+    uint32_t skipDepth;                          // Open brackets inside the skipped or emitted value
+    bool emitting;                               // Whether the current value is a match
+    size_t matchCount;                           // Number of matches written
+    char outputBuffer[JSON_PATH_OUTPUT_SIZE];    // Pending match bytes
+    size_t outputLength;                         // Number of pending match bytes
+};
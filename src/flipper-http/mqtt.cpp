@@ -0,0 +1,681 @@
+#include "mqtt.hpp"
+#include "certs.hpp"
+
+// Control packet types (upper nibble of the first byte)
+#define MQTT_CONNECT 1
+#define MQTT_CONNACK 2
+#define MQTT_PUBLISH 3
+#define MQTT_PUBACK 4
+#define MQTT_SUBSCRIBE 8
+#define MQTT_SUBACK 9
+#define MQTT_PINGREQ 12
+#define MQTT_PINGRESP 13
+#define MQTT_DISCONNECT 14
+
+// Writes the fixed header, returns its length (2 to 5 bytes)
+static size_t mqttWriteHeader(uint8_t *buffer, uint8_t first, size_t remaining)
+{
+    size_t length = 0;
+    buffer[length++] = first;
+    do
+    {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        if (remaining > 0)
+        {
+            digit |= 0x80;
+        }
+        buffer[length++] = digit;
+    } while (remaining > 0);
+    return length;
+}
+
+// Writes a length-prefixed string, returns its length
+static size_t mqttWriteString(uint8_t *buffer, const char *text, size_t length)
+{
+    buffer[0] = length >> 8;
+    buffer[1] = length & 0xFF;
+    memcpy(buffer + 2, text, length);
+    return length + 2;
+}
+
+MqttClient::MqttClient(UART *uart)
+{
+    this->uart = uart;
+    this->secureClient = nullptr;
+    this->plainClient = nullptr;
+    this->client = nullptr;
+    this->port = 0;
+    this->keepAlive = 0;
+    this->cleanSession = true;
+    this->subscriptionCount = 0;
+    for (int i = 0; i < MQTT_QUEUE_SIZE; i++)
+    {
+        this->queue[i].packet = nullptr;
+    }
+    this->packetId = 0;
+    this->active = false;
+    this->isConnected = false;
+    this->pingPending = false;
+    this->reconnectAt = 0;
+    this->receiveState = 0;
+}
+
+MqttClient::~MqttClient()
+{
+    this->disconnect();
+    if (this->secureClient)
+    {
+        delete this->secureClient;
+        this->secureClient = nullptr;
+    }
+    if (this->plainClient)
+    {
+        delete this->plainClient;
+        this->plainClient = nullptr;
+    }
+}
+
+bool MqttClient::connect(const char *url, const char *clientId, const char *username, const char *password, uint16_t keepAlive, bool cleanSession)
+{
+    this->disconnect();
+
+    // Split "mqtt://host:port" or "mqtts://host:port"
+    bool secure = false;
+    if (strncmp(url, "mqtts://", 8) == 0)
+    {
+        secure = true;
+        url += 8;
+    }
+    else if (strncmp(url, "mqtt://", 7) == 0)
+    {
+        url += 7;
+    }
+    const char *end = url;
+    while (*end && *end != ':' && *end != '/')
+    {
+        end++;
+    }
+    if (end == url)
+    {
+        return false;
+    }
+    this->host = url;
+    this->host.remove(end - url);
+    this->port = *end == ':' ? (uint16_t)strtoul(end + 1, nullptr, 10) : (secure ? 8883 : 1883);
+
+    this->clientId = clientId;
+    this->username = username ? username : "";
+    this->password = password ? password : "";
+    this->keepAlive = keepAlive;
+    this->cleanSession = cleanSession;
+    this->subscriptionCount = 0;
+
+    // Only the client for the current scheme is kept
+    this->client = nullptr;
+    if (secure)
+    {
+        if (this->plainClient)
+        {
+            delete this->plainClient;
+            this->plainClient = nullptr;
+        }
+        if (!this->secureClient)
+        {
+#ifndef BOARD_BW16
+            this->secureClient = new WiFiClientSecure();
+#else
+            this->secureClient = new WiFiSSLClient();
+#endif
+            if (!this->secureClient)
+            {
+                return false;
+            }
+#ifndef BOARD_BW16
+            this->secureClient->setCACert(root_ca);
+#else
+            this->secureClient->setRootCA((unsigned char *)root_ca);
+#endif
+        }
+        this->client = this->secureClient;
+    }
+    else
+    {
+        if (this->secureClient)
+        {
+            delete this->secureClient;
+            this->secureClient = nullptr;
+        }
+        if (!this->plainClient)
+        {
+            this->plainClient = new WiFiClient();
+            if (!this->plainClient)
+            {
+                return false;
+            }
+        }
+        this->client = this->plainClient;
+    }
+
+    if (!this->open())
+    {
+        return false;
+    }
+    this->active = true;
+    return true;
+}
+
+bool MqttClient::open()
+{
+    this->client->stop();
+    this->isConnected = false;
+    this->pingPending = false;
+    this->receiveState = 0;
+
+    bool opened = this->client->connect(this->host.c_str(), this->port);
+#ifndef BOARD_BW16
+    if (!opened && this->client == this->secureClient)
+    {
+        // certification failed? retry without SSL on the broker's own client
+        this->secureClient->setInsecure();
+        opened = this->client->connect(this->host.c_str(), this->port);
+    }
+#endif
+    if (!opened)
+    {
+        return false;
+    }
+
+    size_t idLength = this->clientId.length();
+    size_t userLength = this->username.length();
+    size_t passLength = this->password.length();
+    size_t remaining = 10 + 2 + idLength;
+    uint8_t flags = this->cleanSession ? 0x02 : 0x00;
+    if (userLength > 0)
+    {
+        remaining += 2 + userLength;
+        flags |= 0x80;
+    }
+    if (passLength > 0)
+    {
+        remaining += 2 + passLength;
+        flags |= 0x40;
+    }
+
+    uint8_t *packet = (uint8_t *)malloc(5 + remaining);
+    if (!packet)
+    {
+        this->client->stop();
+        return false;
+    }
+    size_t length = mqttWriteHeader(packet, MQTT_CONNECT << 4, remaining);
+    length += mqttWriteString(packet + length, "MQTT", 4);
+    packet[length++] = 4; // protocol level 3.1.1
+    packet[length++] = flags;
+    packet[length++] = this->keepAlive >> 8;
+    packet[length++] = this->keepAlive & 0xFF;
+    length += mqttWriteString(packet + length, this->clientId.c_str(), idLength);
+    if (userLength > 0)
+    {
+        length += mqttWriteString(packet + length, this->username.c_str(), userLength);
+    }
+    if (passLength > 0)
+    {
+        length += mqttWriteString(packet + length, this->password.c_str(), passLength);
+    }
+    bool sent = this->sendPacket(packet, length);
+    free(packet);
+
+    this->lastReceive = millis();
+    if (!sent || !this->waitFor(MQTT_CONNACK, 0, MQTT_ACK_TIMEOUT) || this->ackCode != 0)
+    {
+        this->client->stop();
+        return false;
+    }
+    this->isConnected = true;
+
+    // Restore the subscriptions and resend what the broker never acknowledged
+    for (int i = 0; i < this->subscriptionCount; i++)
+    {
+        uint16_t id = this->nextId();
+        if (!this->sendSubscribe(this->subscriptions[i].c_str(), this->subscriptionQos[i], id) ||
+            !this->waitFor(MQTT_SUBACK, id, MQTT_ACK_TIMEOUT))
+        {
+            this->client->stop();
+            this->isConnected = false;
+            return false;
+        }
+    }
+    for (int i = 0; i < MQTT_QUEUE_SIZE; i++)
+    {
+        Outbound &slot = this->queue[i];
+        if (slot.packet && slot.sent)
+        {
+            slot.packet[0] |= 0x08; // DUP
+            slot.sent = false;
+        }
+    }
+    this->flushQueue();
+    return this->isConnected;
+}
+
+void MqttClient::drop()
+{
+    this->client->stop();
+    this->isConnected = false;
+    this->reconnectAt = millis() + MQTT_RECONNECT_INTERVAL;
+    this->uart->println(F("[MQTT/DISCONNECTED]"));
+}
+
+bool MqttClient::sendPacket(const uint8_t *packet, size_t length)
+{
+    if (this->client->write(packet, length) != length)
+    {
+        return false;
+    }
+    this->lastSend = millis();
+    return true;
+}
+
+bool MqttClient::sendSubscribe(const char *topic, uint8_t qos, uint16_t id)
+{
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + 2 + topicLength + 1;
+    uint8_t *packet = (uint8_t *)malloc(5 + remaining);
+    if (!packet)
+    {
+        return false;
+    }
+    size_t length = mqttWriteHeader(packet, (MQTT_SUBSCRIBE << 4) | 0x02, remaining);
+    packet[length++] = id >> 8;
+    packet[length++] = id & 0xFF;
+    length += mqttWriteString(packet + length, topic, topicLength);
+    packet[length++] = qos;
+    bool sent = this->sendPacket(packet, length);
+    free(packet);
+    return sent;
+}
+
+int MqttClient::subscribe(const char *topic, uint8_t qos)
+{
+    if (!this->isConnected)
+    {
+        return -1;
+    }
+    uint16_t id = this->nextId();
+    if (!this->sendSubscribe(topic, qos, id))
+    {
+        this->drop();
+        return -1;
+    }
+    if (!this->waitFor(MQTT_SUBACK, id, MQTT_ACK_TIMEOUT) || this->ackCode > 2)
+    {
+        return -1;
+    }
+
+    // Remember the topic so it can be restored after a reconnect
+    int index = 0;
+    while (index < this->subscriptionCount && this->subscriptions[index] != topic)
+    {
+        index++;
+    }
+    if (index < MQTT_MAX_SUBSCRIPTIONS)
+    {
+        this->subscriptions[index] = topic;
+        this->subscriptionQos[index] = qos;
+        if (index == this->subscriptionCount)
+        {
+            this->subscriptionCount++;
+        }
+    }
+    return this->ackCode;
+}
+
+int MqttClient::publish(const char *topic, const uint8_t *payload, size_t length, uint8_t qos, bool retain)
+{
+    int index = -1;
+    for (int i = 0; i < MQTT_QUEUE_SIZE; i++)
+    {
+        if (!this->queue[i].packet)
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+    uint8_t *packet = (uint8_t *)malloc(5 + remaining);
+    if (!packet)
+    {
+        return -1;
+    }
+    uint16_t id = qos > 0 ? this->nextId() : 0;
+    size_t packetLength = mqttWriteHeader(packet, (MQTT_PUBLISH << 4) | (qos << 1) | (retain ? 0x01 : 0x00), remaining);
+    packetLength += mqttWriteString(packet + packetLength, topic, topicLength);
+    if (qos > 0)
+    {
+        packet[packetLength++] = id >> 8;
+        packet[packetLength++] = id & 0xFF;
+    }
+    memcpy(packet + packetLength, payload, length);
+    packetLength += length;
+
+    Outbound &slot = this->queue[index];
+    slot.packet = packet;
+    slot.length = packetLength;
+    slot.id = id;
+    slot.qos = qos;
+    slot.sent = false;
+    slot.sentAt = 0;
+
+    if (this->isConnected)
+    {
+        this->flushQueue();
+    }
+    return id;
+}
+
+void MqttClient::flushQueue()
+{
+    unsigned long now = millis();
+    for (int i = 0; i < MQTT_QUEUE_SIZE && this->isConnected; i++)
+    {
+        Outbound &slot = this->queue[i];
+        if (!slot.packet)
+        {
+            continue;
+        }
+        if (slot.sent)
+        {
+            if (now - slot.sentAt < MQTT_RESEND_INTERVAL)
+            {
+                continue;
+            }
+            slot.packet[0] |= 0x08; // DUP
+        }
+        if (!this->sendPacket(slot.packet, slot.length))
+        {
+            this->drop();
+            return;
+        }
+        if (slot.qos == 0)
+        {
+            this->freeSlot(slot);
+        }
+        else
+        {
+            slot.sent = true;
+            slot.sentAt = now;
+        }
+    }
+}
+
+void MqttClient::freeSlot(Outbound &slot)
+{
+    free(slot.packet);
+    slot.packet = nullptr;
+}
+
+uint16_t MqttClient::nextId()
+{
+    if (++this->packetId == 0)
+    {
+        this->packetId = 1;
+    }
+    return this->packetId;
+}
+
+bool MqttClient::receive()
+{
+    uint8_t chunk[128];
+    while (this->client->available() > 0)
+    {
+        int received = this->client->read(chunk, sizeof(chunk));
+        if (received <= 0)
+        {
+            break;
+        }
+        this->lastReceive = millis();
+        for (int i = 0; i < received; i++)
+        {
+            uint8_t c = chunk[i];
+            switch (this->receiveState)
+            {
+            case 0: // fixed header
+                this->receiveType = c;
+                this->receiveRemaining = 0;
+                this->receiveMultiplier = 1;
+                this->receiveState = 1;
+                break;
+            case 1: // remaining length
+                this->receiveRemaining += (c & 0x7F) * this->receiveMultiplier;
+                this->receiveMultiplier *= 128;
+                if (c & 0x80)
+                {
+                    if (this->receiveMultiplier > 128UL * 128 * 128)
+                    {
+                        return false; // malformed remaining length
+                    }
+                    break;
+                }
+                this->receiveLength = 0;
+                if (this->receiveRemaining == 0)
+                {
+                    this->receiveState = 0;
+                    this->handlePacket();
+                }
+                else
+                {
+                    this->receiveState = 2;
+                }
+                break;
+            case 2: // body, anything past the buffer is dropped
+                if (this->receiveLength < MQTT_PACKET_SIZE)
+                {
+                    this->receiveBuffer[this->receiveLength] = c;
+                }
+                this->receiveLength++;
+                if (--this->receiveRemaining == 0)
+                {
+                    this->receiveState = 0;
+                    this->handlePacket();
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+void MqttClient::handlePacket()
+{
+    uint8_t type = this->receiveType >> 4;
+    size_t length = this->receiveLength < MQTT_PACKET_SIZE ? this->receiveLength : MQTT_PACKET_SIZE;
+    uint8_t *body = this->receiveBuffer;
+
+    switch (type)
+    {
+    case MQTT_CONNACK:
+        if (length >= 2)
+        {
+            this->ackType = MQTT_CONNACK;
+            this->ackId = 0;
+            this->ackCode = body[1];
+        }
+        break;
+    case MQTT_SUBACK:
+        if (length >= 3)
+        {
+            this->ackType = MQTT_SUBACK;
+            this->ackId = (body[0] << 8) | body[1];
+            this->ackCode = body[2];
+        }
+        break;
+    case MQTT_PUBACK:
+        if (length >= 2)
+        {
+            uint16_t id = (body[0] << 8) | body[1];
+            for (int i = 0; i < MQTT_QUEUE_SIZE; i++)
+            {
+                Outbound &slot = this->queue[i];
+                if (slot.packet && slot.qos > 0 && slot.id == id)
+                {
+                    this->freeSlot(slot);
+                    this->uart->println("[MQTT/PUBACK]{\"id\":" + String(id) + "}");
+                    break;
+                }
+            }
+        }
+        break;
+    case MQTT_PINGRESP:
+        this->pingPending = false;
+        break;
+    case MQTT_PUBLISH:
+    {
+        uint8_t qos = (this->receiveType >> 1) & 0x03;
+        if (length < 2)
+        {
+            break;
+        }
+        size_t topicLength = (body[0] << 8) | body[1];
+        size_t offset = 2 + topicLength + (qos > 0 ? 2 : 0);
+        if (offset > length)
+        {
+            break;
+        }
+        uint16_t id = qos > 0 ? (body[2 + topicLength] << 8) | body[3 + topicLength] : 0;
+
+        // Terminate the topic and payload in place while they are copied into the document
+        JsonDocument doc;
+        char saved = body[2 + topicLength];
+        body[2 + topicLength] = '\0';
+        doc["topic"] = (const char *)(body + 2);
+        body[2 + topicLength] = saved;
+        body[length] = '\0';
+        doc["payload"] = (const char *)(body + offset);
+        doc["qos"] = qos;
+        doc["retain"] = (this->receiveType & 0x01) != 0;
+        if (this->receiveLength > MQTT_PACKET_SIZE)
+        {
+            doc["truncated"] = true;
+        }
+        String output;
+        serializeJson(doc, output);
+        this->uart->println("[MQTT/MESSAGE]" + output);
+
+        // A QoS 1 publish is only acknowledged when it was forwarded whole. A truncated one is left
+        // unacknowledged so the broker still holds it, rather than being told it was delivered
+        if (qos > 0 && this->receiveLength <= MQTT_PACKET_SIZE)
+        {
+            uint8_t ack[4] = {MQTT_PUBACK << 4, 2, (uint8_t)(id >> 8), (uint8_t)(id & 0xFF)};
+            this->sendPacket(ack, sizeof(ack));
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+bool MqttClient::waitFor(uint8_t type, uint16_t id, uint32_t timeout)
+{
+    this->ackType = 0;
+    unsigned long start = millis();
+    while (millis() - start < timeout)
+    {
+        if (!this->receive() || !this->client->connected())
+        {
+            return false;
+        }
+        if (this->ackType == type && this->ackId == id)
+        {
+            return true;
+        }
+        delay(1);
+    }
+    return false;
+}
+
+void MqttClient::loop()
+{
+    if (!this->active)
+    {
+        return;
+    }
+    if (!this->isConnected)
+    {
+        if ((long)(millis() - this->reconnectAt) < 0)
+        {
+            return;
+        }
+        if (this->open())
+        {
+            this->uart->println(F("[MQTT/CONNECTED]"));
+        }
+        else
+        {
+            this->reconnectAt = millis() + MQTT_RECONNECT_INTERVAL;
+        }
+        return;
+    }
+
+    if (!this->receive() || !this->client->connected())
+    {
+        this->drop();
+        return;
+    }
+    this->flushQueue();
+    if (!this->isConnected || this->keepAlive == 0)
+    {
+        return;
+    }
+
+    // Ping when either direction has been quiet for the keep-alive interval
+    unsigned long now = millis();
+    unsigned long interval = this->keepAlive * 1000UL;
+    if (this->pingPending)
+    {
+        if (now - this->pingSentAt >= MQTT_ACK_TIMEOUT)
+        {
+            this->drop();
+        }
+    }
+    else if (now - this->lastSend >= interval || now - this->lastReceive >= interval)
+    {
+        uint8_t ping[2] = {MQTT_PINGREQ << 4, 0};
+        if (!this->sendPacket(ping, sizeof(ping)))
+        {
+            this->drop();
+            return;
+        }
+        this->pingPending = true;
+        this->pingSentAt = now;
+    }
+}
+
+void MqttClient::disconnect()
+{
+    if (this->isConnected)
+    {
+        uint8_t packet[2] = {MQTT_DISCONNECT << 4, 0};
+        this->sendPacket(packet, sizeof(packet));
+    }
+    if (this->client)
+    {
+        this->client->stop();
+    }
+    this->active = false;
+    this->isConnected = false;
+    for (int i = 0; i < MQTT_QUEUE_SIZE; i++)
+    {
+        if (this->queue[i].packet)
+        {
+            this->freeSlot(this->queue[i]);
+        }
+    }
+}
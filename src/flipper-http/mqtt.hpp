@@ -0,0 +1,101 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "boards.hpp"
+#include "wifi_utils.hpp"
+#include "uart.hpp"
+
+#define MQTT_PACKET_SIZE 1024        // Largest packet kept when received, longer publishes are truncated (and not acknowledged at QoS 1)
+#define MQTT_QUEUE_SIZE 4            // Outbound publishes kept until sent (QoS 0) or acknowledged (QoS 1)
+#define MQTT_MAX_SUBSCRIPTIONS 8     // Subscriptions restored after a reconnect
+#define MQTT_ACK_TIMEOUT 5000        // Time (ms) to wait for CONNACK, SUBACK and PINGRESP
+#define MQTT_RESEND_INTERVAL 10000   // Time (ms) before an unacknowledged QoS 1 publish is sent again
+#define MQTT_RECONNECT_INTERVAL 5000 // Time (ms) between reconnect attempts after the connection drops
+
+// MQTT 3.1.1 client kept open between commands. Incoming publishes are written
+// over UART as they arrive: [MQTT/MESSAGE]{"topic":"...","payload":"...","qos":0,"retain":false}
+class MqttClient
+{
+public:
+    MqttClient(UART *uart);
+    ~MqttClient();
+
+    // Connects to "mqtt://host:1883" or "mqtts://host:8883", returns false if the broker refuses
+    bool connect(
+        const char *url,                // Broker URL
+        const char *clientId,           // Client identifier
+        const char *username = nullptr, // Optional user name
+        const char *password = nullptr, // Optional password
+        uint16_t keepAlive = 60,        // Keep-alive interval in seconds, 0 disables it
+        bool cleanSession = true        // Whether the broker should drop the previous session
+    );
+
+    int subscribe(const char *topic, uint8_t qos);                                                   // Returns the granted QoS, or -1 on failure
+    int publish(const char *topic, const uint8_t *payload, size_t length, uint8_t qos, bool retain); // Queues a publish, returns its packet id (0 for QoS 0) or -1 if the queue is full
+    void loop();                                                                                     // Forwards incoming publishes, sends queued ones, keeps the connection alive
+    void disconnect();                                                                               // Sends DISCONNECT and closes the connection
+    bool connected() const { return this->isConnected; }                                             // Whether the session is open
+
+private:
+    struct Outbound
+    {
+        uint8_t *packet;      // Complete PUBLISH packet, nullptr if the slot is free
+        size_t length;        // Packet length
+        uint16_t id;          // Packet id (QoS 1 only)
+        uint8_t qos;          // Requested QoS
+        bool sent;            // Whether the packet was written at least once
+        unsigned long sentAt; // millis() of the last write
+    };
+
+    bool open();                                                     // Connects the socket and exchanges CONNECT/CONNACK
+    void drop();                                                     // Closes a dead connection, it is reopened after MQTT_RECONNECT_INTERVAL
+    bool sendPacket(const uint8_t *packet, size_t length);           // Writes a complete packet
+    bool sendSubscribe(const char *topic, uint8_t qos, uint16_t id); // Writes a SUBSCRIBE packet
+    void flushQueue();                                               // Writes pending publishes and resends unacknowledged ones
+    bool receive();                                                  // Parses available bytes, returns false if the connection failed
+    void handlePacket();                                             // Acts on the packet in the receive buffer
+    bool waitFor(uint8_t type, uint16_t id, uint32_t timeout);       // Handles packets until the given acknowledgement arrives
+    uint16_t nextId();                                               // Next non-zero packet id
+    void freeSlot(Outbound &slot);                                   // Releases a queue slot
+
+    UART *uart; // UART object to handle serial communication
+#ifndef BOARD_BW16
+    WiFiClientSecure *secureClient; // Dedicated client for mqtts:// so the session survives other requests, nullptr for mqtt://
+#else
+    WiFiSSLClient *secureClient; // Dedicated client for mqtts:// so the session survives other requests, nullptr for mqtt://
+#endif
+    WiFiClient *plainClient; // Dedicated client for mqtt://, nullptr for mqtts://
+    Client *client;          // The client in use
+
+    String host;        // Broker host
+    uint16_t port;      // Broker port
+    String clientId;    // Client identifier
+    String username;    // User name, empty if none
+    String password;    // Password, empty if none
+    uint16_t keepAlive; // Keep-alive interval in seconds
+    bool cleanSession;  // Clean session flag sent with CONNECT
+
+    String subscriptions[MQTT_MAX_SUBSCRIPTIONS];    // Topics restored after a reconnect
+    uint8_t subscriptionQos[MQTT_MAX_SUBSCRIPTIONS]; // QoS of each restored topic
+    int subscriptionCount;                           // Number of restored topics
+    Outbound queue[MQTT_QUEUE_SIZE];                 // Outbound publishes
+    uint16_t packetId;                               // Last packet id used
+
+    bool active;               // Whether connect() succeeded and disconnect() wasn't called
+    bool isConnected;          // Whether the session is open
+    unsigned long lastSend;    // millis() of the last write
+    unsigned long lastReceive; // millis() of the last byte received
+    bool pingPending;          // Whether a PINGREQ is waiting for its PINGRESP
+    unsigned long pingSentAt;  // millis() when the pending PINGREQ was sent
+    unsigned long reconnectAt; // millis() of the next reconnect attempt
+
+    uint8_t receiveBuffer[MQTT_PACKET_SIZE + 1]; // Body of the packet being received, plus a terminator
+    uint8_t receiveState;                        // 0: fixed header, 1: remaining length, 2: body
+    uint8_t receiveType;                         // First byte of the packet being received
+    size_t receiveRemaining;                     // Body bytes still to come
+    size_t receiveLength;                        // Body bytes received so far
+    size_t receiveMultiplier;                    // Remaining length decoding multiplier
+    uint8_t ackType;                             // Type of the last CONNACK or SUBACK
+    uint16_t ackId;                              // Packet id of the last SUBACK
+    uint8_t ackCode;                             // Return code of the last CONNACK or SUBACK
+};
@@ -0,0 +1,141 @@
+#include "parse_cache.hpp"
+
+// Resolves a path such as "data.items[2].name" (an optional leading "$" is ignored)
+static JsonVariantConst resolvePath(JsonVariantConst node, const char *path)
+{
+    if (*path == '$')
+    {
+        path++;
+    }
+    while (*path && !node.isNull())
+    {
+        if (*path == '.')
+        {
+            path++;
+        }
+        else if (*path == '[')
+        {
+            char *end = nullptr;
+            long index = strtol(path + 1, &end, 10);
+            if (end == path + 1 || *end != ']' || index < 0)
+            {
+                return JsonVariantConst();
+            }
+            node = node[(size_t)index];
+            path = end + 1;
+        }
+        else
+        {
+            char key[64];
+            size_t len = 0;
+            while (*path && *path != '.' && *path != '[')
+            {
+                if (len < sizeof(key) - 1)
+                {
+                    key[len++] = *path;
+                }
+                path++;
+            }
+            key[len] = '\0';
+            node = node[key];
+        }
+    }
+    return node;
+}
+
+ParseCache::ParseCache(UART *uart)
+{
+    this->uart = uart;
+    for (int i = 0; i < PARSE_MAX_HANDLES; i++)
+    {
+        this->documents[i] = nullptr;
+    }
+}
+
+ParseCache::~ParseCache()
+{
+    for (int i = 0; i < PARSE_MAX_HANDLES; i++)
+    {
+        this->release(i);
+    }
+}
+
+int ParseCache::allocate()
+{
+    for (int i = 0; i < PARSE_MAX_HANDLES; i++)
+    {
+        if (!this->documents[i])
+        {
+            this->documents[i] = new JsonDocument();
+            if (!this->documents[i])
+            {
+                this->uart->println(F("[ERROR] Failed to allocate JSON document."));
+                return -1;
+            }
+            return i;
+        }
+    }
+    this->uart->println(F("[ERROR] Too many parsed documents loaded."));
+    return -1;
+}
+
+int ParseCache::load(const String &json)
+{
+    int handle = this->allocate();
+    if (handle == -1)
+    {
+        return -1;
+    }
+    DeserializationError error = deserializeJson(*this->documents[handle], json);
+    if (error)
+    {
+        this->release(handle);
+        this->uart->println(F("[ERROR] Failed to parse JSON."));
+        return -1;
+    }
+    return handle;
+}
+
+int ParseCache::store(JsonVariantConst json)
+{
+    int handle = this->allocate();
+    if (handle == -1)
+    {
+        return -1;
+    }
+    if (!this->documents[handle]->set(json))
+    {
+        this->release(handle);
+        this->uart->println(F("[ERROR] Not enough memory to store JSON."));
+        return -1;
+    }
+    return handle;
+}
+
+bool ParseCache::get(int handle, const char *path)
+{
+    if (handle < 0 || handle >= PARSE_MAX_HANDLES || !this->documents[handle])
+    {
+        this->uart->println(F("[ERROR] Invalid parse handle."));
+        return false;
+    }
+    JsonVariantConst value = resolvePath(this->documents[handle]->as<JsonVariantConst>(), path);
+    if (value.isNull())
+    {
+        this->uart->println(F("[ERROR] Key not found in JSON."));
+        return false;
+    }
+    this->uart->println(value.as<String>());
+    return true;
+}
+
+bool ParseCache::release(int handle)
+{
+    if (handle < 0 || handle >= PARSE_MAX_HANDLES || !this->documents[handle])
+    {
+        return false;
+    }
+    delete this->documents[handle];
+    this->documents[handle] = nullptr;
+    return true;
+}
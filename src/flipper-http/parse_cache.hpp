@@ -0,0 +1,26 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "uart.hpp"
+
+#define PARSE_MAX_HANDLES 4     // Number of parsed documents that can be kept at once
+#define PARSE_MAX_RETAINED 8192 // Largest HTTP response kept for [PARSE/LOAD] from the last response
+
+// Keeps parsed JSON documents on the device so repeated lookups don't re-send or re-parse them
+class ParseCache
+{
+public:
+    ParseCache(UART *uart);
+    ~ParseCache();
+
+    int load(const String &json);           // Parses json into a free handle, returns the handle or -1 on failure
+    int store(JsonVariantConst json);       // Copies an already parsed value into a free handle, returns the handle or -1 on failure
+    bool get(int handle, const char *path); // Prints the value at path (e.g. "data.items[2].name"), returns false if not found
+    bool release(int handle);               // Frees a handle, returns false if it was not in use
+
+private:
+    int allocate(); // Returns a free handle with an empty document, or -1
+
+    UART *uart;                                 // UART object to handle serial communication
+    JsonDocument *documents[PARSE_MAX_HANDLES]; // Parsed documents, indexed by handle
+};
@@ -0,0 +1,331 @@
+#include "poll.hpp"
+#include "certs.hpp"
+#include "common.hpp"
+
+Poller::Poller(UART *uart)
+    : clientStream(&this->client), connection(&this->clientStream)
+{
+    this->uart = uart;
+    this->receivedEtag[0] = '\0';
+    for (int i = 0; i < POLL_MAX_HANDLES; i++)
+    {
+        this->polls[i].running = false;
+    }
+    this->current = -1;
+    this->lastStarted = POLL_MAX_HANDLES - 1; // the first scan starts at poll 0
+    this->phase = PHASE_HEADERS;
+    this->retried = false;
+    this->lastData = 0;
+    this->status = 0;
+    this->body = nullptr;
+    this->size = 0;
+    this->kept = 0;
+    this->hash = 0;
+#ifndef BOARD_BW16
+    this->client.setCACert(root_ca);
+#else
+    this->client.setRootCA((unsigned char *)root_ca);
+#endif
+}
+
+Poller::~Poller()
+{
+    this->finish();
+    this->connection.close();
+}
+
+int Poller::start(const String &url, uint32_t interval, const char *headerKeys[], const char *headerValues[], int headerSize)
+{
+    char host[HTTP_CORE_HOST_SIZE];
+    uint16_t port;
+    const char *path;
+    bool secure;
+    if (!httpSplitUrl(url.c_str(), host, sizeof(host), &port, &path, &secure))
+    {
+        this->uart->println(F("[ERROR] Invalid poll URL."));
+        return -1;
+    }
+
+    int id = 0;
+    while (id < POLL_MAX_HANDLES && this->polls[id].running)
+    {
+        id++;
+    }
+    if (id == POLL_MAX_HANDLES)
+    {
+        this->uart->println(F("[ERROR] No free poll handles."));
+        return -1;
+    }
+
+    Poll &poll = this->polls[id];
+    poll.running = true;
+    poll.url = url;
+    poll.headerSize = headerSize > POLL_MAX_HEADERS ? POLL_MAX_HEADERS : headerSize;
+    for (int i = 0; i < poll.headerSize; i++)
+    {
+        poll.headerKeys[i] = headerKeys[i];
+        poll.headerValues[i] = headerValues[i];
+    }
+    poll.interval = interval < POLL_MIN_INTERVAL ? POLL_MIN_INTERVAL : interval;
+    poll.nextAt = millis(); // the first response is always forwarded
+    poll.etag[0] = '\0';
+    poll.hash = 0;
+    poll.status = 0;
+    return id;
+}
+
+bool Poller::stop(int id)
+{
+    if (id < 0 || id >= POLL_MAX_HANDLES || !this->polls[id].running)
+    {
+        return false;
+    }
+    if (id == this->current)
+    {
+        this->connection.close(); // the rest of its response is not wanted
+        this->finish();
+    }
+    Poll &poll = this->polls[id];
+    poll.running = false;
+    poll.url = "";
+    for (int i = 0; i < poll.headerSize; i++)
+    {
+        poll.headerKeys[i] = "";
+        poll.headerValues[i] = "";
+    }
+    if (!this->active())
+    {
+        this->connection.close();
+    }
+    return true;
+}
+
+bool Poller::active() const
+{
+    for (int i = 0; i < POLL_MAX_HANDLES; i++)
+    {
+        if (this->polls[i].running)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Poller::loop()
+{
+    if (this->current >= 0)
+    {
+        this->advance();
+        return;
+    }
+
+    // One request at a time keeps the UART responsive while several polls are due, and starting
+    // after the last one run keeps a slow poll that is always due again from starving the others
+    for (int n = 1; n <= POLL_MAX_HANDLES; n++)
+    {
+        int i = (this->lastStarted + n) % POLL_MAX_HANDLES;
+        if (this->polls[i].running && (long)(millis() - this->polls[i].nextAt) >= 0)
+        {
+            this->begin(i);
+            return;
+        }
+    }
+}
+
+void Poller::collectEtag(void *context, const char *name, const char *value)
+{
+    if (strcasecmp(name, "ETag") == 0)
+    {
+        snprintf((char *)context, POLL_ETAG_SIZE, "%s", value);
+    }
+}
+
+void Poller::begin(int id)
+{
+    Poll &poll = this->polls[id];
+    poll.nextAt = millis() + poll.interval;
+    this->current = id;
+    this->lastStarted = id;
+    this->phase = PHASE_HEADERS;
+    this->retried = false;
+    if (!this->send(id))
+    {
+        this->retry();
+    }
+}
+
+bool Poller::send(int id)
+{
+    Poll &poll = this->polls[id];
+    char host[HTTP_CORE_HOST_SIZE];
+    uint16_t port;
+    const char *path;
+    bool secure;
+    httpSplitUrl(poll.url.c_str(), host, sizeof(host), &port, &path, &secure);
+
+    // Ask the server to skip an unchanged body when it gave an ETag before
+    const char *keys[POLL_MAX_HEADERS + 1];
+    const char *values[POLL_MAX_HEADERS + 1];
+    int count = 0;
+    for (int i = 0; i < poll.headerSize; i++)
+    {
+        keys[count] = poll.headerKeys[i].c_str();
+        values[count] = poll.headerValues[i].c_str();
+        count++;
+    }
+    if (poll.etag[0] != '\0')
+    {
+        keys[count] = "If-None-Match";
+        values[count] = poll.etag;
+        count++;
+    }
+
+    size_t headLength;
+    char *head = httpNewRequestHead(headLength, "GET", host, port, path, keys, values, count, -2, true);
+    if (!head)
+    {
+        return false;
+    }
+
+    this->receivedEtag[0] = '\0';
+    this->parser.onHeader(collectEtag, this->receivedEtag);
+    this->parser.reset();
+    bool sent = this->connection.open(host, port) && this->connection.send((const uint8_t *)head, headLength);
+    free(head);
+    if (!sent)
+    {
+        this->connection.close();
+        return false;
+    }
+    this->lastData = millis();
+    return true;
+}
+
+void Poller::advance()
+{
+    if (this->phase == PHASE_HEADERS)
+    {
+        // A zero timeout reads what has arrived and keeps the parser's place until the next call
+        int status = this->connection.readHeaders(this->parser, 0);
+        if (status < 0)
+        {
+            if (this->parser.failed() || !this->clientStream.connected())
+            {
+                this->retry();
+            }
+            else if (millis() - this->lastData > POLL_TIMEOUT)
+            {
+                this->fail();
+            }
+            return;
+        }
+        if (status == 304)
+        {
+            this->connection.end(this->parser); // not modified
+            this->finish();
+            return;
+        }
+
+        this->body = (uint8_t *)malloc(POLL_MAX_BODY);
+        if (!this->body)
+        {
+            this->connection.close();
+            this->finish();
+            this->uart->println(F("[ERROR] Failed to allocate memory for the poll response."));
+            return;
+        }
+        this->status = status;
+        this->size = 0;
+        this->kept = 0;
+        this->hash = 0;
+        this->phase = PHASE_BODY;
+        this->lastData = millis();
+    }
+
+    // Hash the whole body but only keep what can be forwarded
+    const uint8_t *data;
+    int received;
+    while ((received = this->connection.readBody(this->parser, data, 0)) > 0)
+    {
+        this->hash = commonCrc32(data, received, this->hash);
+        size_t room = POLL_MAX_BODY - this->kept;
+        size_t copy = (size_t)received < room ? (size_t)received : room;
+        memcpy(this->body + this->kept, data, copy);
+        this->kept += copy;
+        this->size += received;
+        this->lastData = millis();
+    }
+    if (received < 0)
+    {
+        if (this->parser.failed() || !this->clientStream.connected() || millis() - this->lastData > POLL_TIMEOUT)
+        {
+            this->fail();
+        }
+        return; // the rest of the body hasn't arrived yet
+    }
+    this->connection.end(this->parser);
+    this->forward();
+    this->finish();
+}
+
+void Poller::forward()
+{
+    Poll &poll = this->polls[this->current];
+    snprintf(poll.etag, sizeof(poll.etag), "%s", this->receivedEtag);
+    if (this->status == poll.status && this->hash == poll.hash)
+    {
+        return;
+    }
+    poll.status = this->status;
+    poll.hash = this->hash;
+
+    JsonDocument doc;
+    doc["id"] = this->current;
+    doc["status"] = this->status;
+    doc["size"] = this->size;
+    if (this->kept < this->size)
+    {
+        doc["truncated"] = true;
+    }
+    String output;
+    serializeJson(doc, output);
+    this->uart->println("[POLL/CHANGED]" + output);
+    this->uart->write(this->body, this->kept);
+    this->uart->println();
+    this->uart->println(F("[POLL/END]"));
+}
+
+void Poller::retry()
+{
+    // A kept-alive connection may have been closed by the server since the last poll, so try twice
+    this->connection.close();
+    if (!this->retried && this->phase == PHASE_HEADERS)
+    {
+        this->retried = true;
+        if (this->send(this->current))
+        {
+            return;
+        }
+    }
+    this->fail();
+}
+
+void Poller::fail()
+{
+    char error[64];
+    snprintf(error, sizeof(error), "[ERROR] Poll %d request failed.", this->current);
+    this->uart->println(error);
+    this->connection.close();
+    this->finish();
+}
+
+void Poller::finish()
+{
+    if (this->body)
+    {
+        free(this->body);
+        this->body = nullptr;
+    }
+    this->current = -1;
+}
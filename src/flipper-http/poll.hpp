@@ -0,0 +1,93 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "uart.hpp"
+#include "http.hpp"
+
+#define POLL_MAX_HANDLES 4     // Number of polls that can run at once
+#define POLL_MAX_HEADERS 10    // Number of custom headers kept per poll
+#define POLL_MAX_BODY 4096     // Largest body forwarded, longer bodies are cut off (but fully hashed)
+#define POLL_ETAG_SIZE 64      // Longest ETag kept
+#define POLL_MIN_INTERVAL 1000 // Shortest interval (ms) between requests of one poll
+#define POLL_TIMEOUT 10000     // Time (ms) without response bytes after which a poll request fails
+
+// Device-side polling: each poll re-fetches its URL on an interval and only
+// forwards the response when it changed, using If-None-Match when the server
+// sends an ETag and a CRC-32 of the body otherwise:
+// [POLL/CHANGED]{"id":0,"status":200,"size":123}
+// <body>
+// [POLL/END]
+// A request in flight is advanced by loop() without waiting for the server,
+// so commands keep being read while it answers; only connecting blocks.
+class Poller
+{
+public:
+    Poller(UART *uart);
+    ~Poller();
+
+    // Starts polling url every interval ms, returns the poll id or -1 if none are free
+    int start(
+        const String &url,                    // URL to poll
+        uint32_t interval,                    // Interval in ms, at least POLL_MIN_INTERVAL
+        const char *headerKeys[] = nullptr,   // Array of header keys
+        const char *headerValues[] = nullptr, // Array of header values
+        int headerSize = 0                    // Number of headers
+    );
+
+    bool stop(int id);   // Stops a poll, returns false if it was not running
+    void loop();         // Advances the request in flight, or starts the next poll that is due
+    bool active() const; // Whether any poll is running
+
+private:
+    struct Poll
+    {
+        bool running;                          // Whether the slot is in use
+        String url;                            // URL to poll
+        String headerKeys[POLL_MAX_HEADERS];   // Custom header keys sent with every request
+        String headerValues[POLL_MAX_HEADERS]; // Custom header values sent with every request
+        int headerSize;                        // Number of custom headers
+        uint32_t interval;                     // Interval in ms
+        unsigned long nextAt;                  // millis() of the next request
+        char etag[POLL_ETAG_SIZE];             // ETag of the last forwarded response, empty if none
+        uint32_t hash;                         // CRC-32 of the last forwarded body
+        int status;                            // Status of the last forwarded response, 0 before the first
+    };
+
+    enum Phase
+    {
+        PHASE_HEADERS, // Waiting for the status line and headers
+        PHASE_BODY,    // Reading the body
+    };
+
+    void begin(int id);                                                          // Sends the request of a poll that is due
+    bool send(int id);                                                           // Opens the connection and writes the request, returns false on failure
+    void advance();                                                              // Reads whatever part of the response arrived, without waiting
+    void forward();                                                              // Writes the response over UART if it changed
+    void retry();                                                                // Sends the request once more after a failure before the headers, else fails
+    void fail();                                                                 // Reports the request in flight as failed and drops it
+    void finish();                                                               // Releases the request in flight
+    static void collectEtag(void *context, const char *name, const char *value); // Keeps the ETag header of the response
+
+    UART *uart; // UART object to handle serial communication
+#ifndef BOARD_BW16
+    WiFiClientSecure client; // Dedicated client so kept-alive polls survive other requests
+#else
+    WiFiSSLClient client; // Dedicated client so kept-alive polls survive other requests
+#endif
+    ClientStream clientStream;         // The client as seen by the HTTP core
+    HttpConnection connection;         // Connection shared by all polls, reused while the host stays the same
+    HttpResponseParser parser;         // Parses each poll response
+    char receivedEtag[POLL_ETAG_SIZE]; // ETag of the response being read
+    Poll polls[POLL_MAX_HANDLES];      // Polls, indexed by id
+
+    int current;             // Poll whose request is in flight, -1 if none
+    int lastStarted;         // Poll whose request was sent last
+    Phase phase;             // Part of the response being read
+    bool retried;            // Whether the request in flight was already sent twice
+    unsigned long lastData;  // millis() of the request or the last response bytes
+    int status;              // Status of the response being read
+    uint8_t *body;           // Forwarded part of the body, only allocated while reading one
+    size_t size;             // Body bytes received
+    size_t kept;             // Body bytes kept in body
+    uint32_t hash;           // CRC-32 of the body so far
+};
@@ -0,0 +1,243 @@
+#include "rfile.hpp"
+
+RemoteFile::RemoteFile(UART *uart, HTTP *http)
+{
+    this->uart = uart;
+    this->http = http;
+    this->headerSize = 0;
+    this->accessCounter = 0;
+    for (int i = 0; i < RFILE_CACHE_BLOCKS; i++)
+    {
+        this->cache[i].valid = false;
+    }
+    this->close();
+}
+
+RemoteFile::~RemoteFile()
+{
+    this->close();
+}
+
+bool RemoteFile::open(String url, const char *headerKeys[], const char *headerValues[], int headerSize)
+{
+    this->close();
+    this->url = url;
+    this->headerSize = headerSize > RFILE_MAX_HEADERS ? RFILE_MAX_HEADERS : headerSize;
+    for (int i = 0; i < this->headerSize; i++)
+    {
+        this->headerKeys[i] = headerKeys[i];
+        this->headerValues[i] = headerValues[i];
+    }
+
+    // The first block also tells us the total size through Content-Range
+    Block *block = this->getBlock(0);
+    if (!block)
+    {
+        this->uart->println(F("[ERROR] Failed to open remote file, the server must support Range requests."));
+        this->close();
+        return false;
+    }
+    this->isOpen = true;
+    return true;
+}
+
+bool RemoteFile::read(size_t offset, size_t length)
+{
+    if (!this->isOpen)
+    {
+        this->uart->println(F("[ERROR] Remote file is not open."));
+        return false;
+    }
+    this->prefetchPending = false;
+    if (this->sizeKnown && offset >= this->fileSize)
+    {
+        this->uart->println(F("[ERROR] Offset is past the end of the remote file."));
+        return false;
+    }
+
+    // Make sure the first slice is available before announcing the read
+    size_t blockStart = (offset / RFILE_BLOCK_SIZE) * RFILE_BLOCK_SIZE;
+    Block *block = this->getBlock(blockStart);
+    if (!block)
+    {
+        if (this->pastEnd)
+        {
+            this->uart->println(F("[ERROR] Offset is past the end of the remote file."));
+        }
+        else
+        {
+            this->uart->println(F("[ERROR] Remote file read failed."));
+        }
+        return false;
+    }
+
+    if (!this->sizeKnown)
+    {
+        // The announced length can only count bytes known to exist, so the read is cut to the blocks
+        // the cache holds and fetched up front; a short block or a 416 marks where the file ends
+        size_t limit = RFILE_CACHE_BLOCKS * RFILE_BLOCK_SIZE - (offset - blockStart);
+        if (length > limit)
+        {
+            length = limit;
+        }
+        for (size_t start = blockStart + RFILE_BLOCK_SIZE; start < offset + length && !this->sizeKnown; start += RFILE_BLOCK_SIZE)
+        {
+            if (!this->getBlock(start))
+            {
+                if (this->pastEnd)
+                {
+                    this->fileSize = start; // the block before ended exactly here
+                    this->sizeKnown = true;
+                }
+                else
+                {
+                    length = start - offset;
+                }
+                break;
+            }
+        }
+    }
+    if (this->sizeKnown)
+    {
+        if (offset >= this->fileSize)
+        {
+            this->uart->println(F("[ERROR] Offset is past the end of the remote file."));
+            return false;
+        }
+        if (length > this->fileSize - offset)
+        {
+            length = this->fileSize - offset;
+        }
+    }
+
+    char headerResponse[96];
+    snprintf(headerResponse, sizeof(headerResponse), "[RFILE/SUCCESS]{\"offset\":%lu,\"length\":%lu}", (unsigned long)offset, (unsigned long)length);
+    this->uart->println(headerResponse);
+
+    size_t pos = offset;
+    size_t end = offset + length;
+    while (pos < end)
+    {
+        blockStart = (pos / RFILE_BLOCK_SIZE) * RFILE_BLOCK_SIZE;
+        block = this->getBlock(blockStart);
+        if (!block || block->length <= pos - blockStart)
+        {
+            this->uart->println();
+            this->uart->println(F("[ERROR] Remote file read failed."));
+            return false;
+        }
+        size_t count = block->length - (pos - blockStart);
+        if (count > end - pos)
+        {
+            count = end - pos;
+        }
+        this->uart->write(block->data + (pos - blockStart), count);
+        pos += count;
+    }
+
+    this->uart->flush();
+    this->uart->println();
+    this->uart->println(F("[RFILE/END]"));
+
+    // Sequential reads leave the next block to prefetch() while the Flipper handles this one
+    bool sequential = offset == this->lastEnd;
+    this->lastEnd = end;
+    this->prefetchOffset = ((end + RFILE_BLOCK_SIZE - 1) / RFILE_BLOCK_SIZE) * RFILE_BLOCK_SIZE;
+    this->prefetchPending = sequential && (!this->sizeKnown || this->prefetchOffset < this->fileSize);
+    return true;
+}
+
+bool RemoteFile::prefetch()
+{
+    if (!this->prefetchPending)
+    {
+        return false;
+    }
+    this->prefetchPending = false;
+    this->getBlock(this->prefetchOffset); // a failure is retried by the next read
+    return true;
+}
+
+void RemoteFile::close()
+{
+    for (int i = 0; i < RFILE_CACHE_BLOCKS; i++)
+    {
+        this->cache[i].valid = false;
+    }
+    this->isOpen = false;
+    this->sizeKnown = false;
+    this->pastEnd = false;
+    this->fileSize = 0;
+    this->lastEnd = 0;
+    this->prefetchPending = false;
+    this->prefetchOffset = 0;
+}
+
+RemoteFile::Block *RemoteFile::getBlock(size_t offset)
+{
+    this->accessCounter++;
+
+    // Cache hit
+    for (int i = 0; i < RFILE_CACHE_BLOCKS; i++)
+    {
+        if (this->cache[i].valid && this->cache[i].offset == offset)
+        {
+            this->cache[i].lastUsed = this->accessCounter;
+            return &this->cache[i];
+        }
+    }
+
+    // Cache miss: evict the least recently used block
+    Block *victim = &this->cache[0];
+    for (int i = 1; i < RFILE_CACHE_BLOCKS; i++)
+    {
+        if (!this->cache[i].valid || (victim->valid && this->cache[i].lastUsed < victim->lastUsed))
+        {
+            victim = &this->cache[i];
+        }
+    }
+    if (!this->fetch(*victim, offset))
+    {
+        return nullptr;
+    }
+    victim->lastUsed = this->accessCounter;
+    return victim;
+}
+
+bool RemoteFile::fetch(Block &block, size_t offset)
+{
+    block.valid = false;
+    this->pastEnd = false;
+
+    const char *keys[RFILE_MAX_HEADERS];
+    const char *values[RFILE_MAX_HEADERS];
+    for (int i = 0; i < this->headerSize; i++)
+    {
+        keys[i] = this->headerKeys[i].c_str();
+        values[i] = this->headerValues[i].c_str();
+    }
+
+    size_t total = 0;
+    int received = this->http->fetchRange(this->url, keys, values, this->headerSize, offset, block.data, RFILE_BLOCK_SIZE, total);
+    if (received <= 0)
+    {
+        this->pastEnd = received == 0;
+        return false;
+    }
+    if (total > 0)
+    {
+        this->fileSize = total;
+        this->sizeKnown = true;
+    }
+    else if (received < RFILE_BLOCK_SIZE)
+    {
+        // A short block is the last one of a file whose size the server didn't give
+        this->fileSize = offset + received;
+        this->sizeKnown = true;
+    }
+
+    block.offset = offset;
+    block.length = received;
+    block.valid = true;
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <Arduino.h>
+#include "boards.hpp"
+#include "uart.hpp"
+#include "http.hpp"
+
+#define RFILE_MAX_HANDLES 2   // Number of remote files that can be open at once
+#define RFILE_MAX_HEADERS 10  // Number of custom headers kept per remote file
+#define RFILE_BLOCK_SIZE 1024 // Bytes fetched per Range request
+#define RFILE_CACHE_BLOCKS 2  // Number of cached blocks per remote file
+
+// A remote file read in slices with Range requests over the HTTP object's kept-alive connection
+class RemoteFile
+{
+public:
+    RemoteFile(UART *uart, HTTP *http);
+    ~RemoteFile();
+
+    // Fetches the first block to learn the file size, returns false on failure
+    bool open(
+        String url,                           // URL of the remote file
+        const char *headerKeys[] = nullptr,   // Array of header keys
+        const char *headerValues[] = nullptr, // Array of header values
+        int headerSize = 0                    // Number of headers
+    );
+
+    // Writes length bytes starting at offset over UART, returns false on failure.
+    // While the size is unknown a read is limited to the blocks the cache can hold
+    bool read(size_t offset, size_t length);
+
+    bool prefetch(); // Fetches the block after the last sequential read if one is due, returns true if there was one. Called from the main loop while the UART is idle
+    void close();    // Drops the cache, the shared connection stays open
+
+    long size() const { return this->sizeKnown ? (long)this->fileSize : -1; } // Total size of the remote file, -1 until known
+
+private:
+    struct Block
+    {
+        size_t offset;                  // File offset of the first byte in data
+        size_t length;                  // Number of valid bytes in data
+        uint32_t lastUsed;              // Access stamp for LRU eviction
+        bool valid;                     // Whether the block holds data
+        uint8_t data[RFILE_BLOCK_SIZE]; // Cached bytes
+    };
+
+    Block *getBlock(size_t offset);          // Returns the cached block that starts at offset, fetching it on a miss
+    bool fetch(Block &block, size_t offset); // Fetches the block starting at offset with a Range request
+
+    UART *uart;                             // UART object to handle serial communication
+    HTTP *http;                             // Shared HTTP object, so reads reuse the connection of other requests to the same host
+    String url;                             // URL of the remote file
+    String headerKeys[RFILE_MAX_HEADERS];   // Custom header keys sent with every request
+    String headerValues[RFILE_MAX_HEADERS]; // Custom header values sent with every request
+    int headerSize;                         // Number of custom headers
+    bool isOpen;                            // Whether open() succeeded
+    bool sizeKnown;                         // Whether fileSize is known, servers may answer "Content-Range: bytes 0-1023/*"
+    bool pastEnd;                           // Whether the last fetch was refused as past the end of the file (416)
+    size_t fileSize;                        // Total size of the remote file, once known
+    size_t lastEnd;                         // End offset of the previous read, used to detect sequential access
+    bool prefetchPending;                   // Whether prefetch() should fetch prefetchOffset
+    size_t prefetchOffset;                  // Block to fetch after a sequential read
+    uint32_t accessCounter;                 // Incremented on every block access
+    Block cache[RFILE_CACHE_BLOCKS];        // Read-ahead block cache
+};
@@ -0,0 +1,155 @@
+#include "socket_sessions.hpp"
+#include "http_core.hpp"
+
+SocketSessions::SocketSessions(UART *uart)
+{
+    this->uart = uart;
+    for (int i = 0; i < SOCKET_MAX_SESSIONS; i++)
+    {
+        this->sessions[i] = nullptr;
+    }
+}
+
+SocketSessions::~SocketSessions()
+{
+    for (int i = 0; i < SOCKET_MAX_SESSIONS; i++)
+    {
+        this->close(i);
+    }
+}
+
+int SocketSessions::open(const String &url, uint16_t port, const char *headerKeys[], const char *headerValues[], int headerSize, uint32_t pingInterval, uint32_t pongTimeout, uint8_t deflateBits, bool noContextTakeover)
+{
+    char host[HTTP_CORE_HOST_SIZE];
+    uint16_t urlPort;
+    const char *path;
+    bool secure;
+    if (!httpSplitUrl(url.c_str(), host, sizeof(host), &urlPort, &path, &secure))
+    {
+        this->uart->println(F("[ERROR] Invalid WebSocket URL."));
+        return -1;
+    }
+
+    int id = 0;
+    while (id < SOCKET_MAX_SESSIONS && this->sessions[id])
+    {
+        id++;
+    }
+    if (id == SOCKET_MAX_SESSIONS)
+    {
+        this->uart->println(F("[ERROR] No free socket sessions."));
+        return -1;
+    }
+
+    WebSocket *session = new WebSocket();
+    if (!session)
+    {
+        this->uart->println(F("[ERROR] Failed to allocate WebSocket object."));
+        return -1;
+    }
+    session->setDeflate(deflateBits, noContextTakeover);
+    if (!session->connect(host, port ? port : urlPort, path, headerKeys, headerValues, headerSize, secure))
+    {
+        delete session;
+        char error[128];
+        snprintf(error, sizeof(error), "[ERROR] Failed to connect WebSocket to %s:%d%s", host, port ? port : urlPort, path);
+        this->uart->println(error);
+        return -1;
+    }
+    session->setKeepAlive(pingInterval, pongTimeout);
+    this->sessions[id] = session;
+    return id;
+}
+
+WebSocket *SocketSessions::get(int id)
+{
+    if (id < 0 || id >= SOCKET_MAX_SESSIONS)
+    {
+        return nullptr;
+    }
+    return this->sessions[id];
+}
+
+bool SocketSessions::close(int id)
+{
+    WebSocket *session = this->get(id);
+    if (!session)
+    {
+        return false;
+    }
+    session->flush();
+    delete session; // sends the close frame
+    this->sessions[id] = nullptr;
+    return true;
+}
+
+bool SocketSessions::active() const
+{
+    for (int i = 0; i < SOCKET_MAX_SESSIONS; i++)
+    {
+        if (this->sessions[i])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SocketSessions::closed(int id)
+{
+    delete this->sessions[id];
+    this->sessions[id] = nullptr;
+    this->uart->println("[SOCKET/CLOSED]{\"id\":" + String(id) + "}");
+}
+
+void SocketSessions::loop()
+{
+    for (int i = 0; i < SOCKET_MAX_SESSIONS; i++)
+    {
+        WebSocket *session = this->sessions[i];
+        if (!session)
+        {
+            continue;
+        }
+        if (!session->isConnected() || !session->service())
+        {
+            this->closed(i);
+            continue;
+        }
+        uint32_t rtt;
+        if (session->takeRtt(rtt))
+        {
+            this->uart->println("[SOCKET/RTT]{\"id\":" + String(i) + ",\"ms\":" + String(rtt) + "}");
+        }
+        if (session->available())
+        {
+            this->forward(i);
+        }
+    }
+}
+
+void SocketSessions::forward(int id)
+{
+    WebSocket *session = this->sessions[id];
+    uint8_t buffer[128];
+    bool binary;
+    int length = session->recv(buffer, sizeof(buffer), binary);
+    if (length < 0)
+    {
+        return; // only control frames so far, or the session ended and is reported on the next loop
+    }
+
+    JsonDocument doc;
+    doc["id"] = id;
+    doc["length"] = length;
+    if (binary)
+    {
+        doc["binary"] = true;
+    }
+    String header;
+    serializeJson(doc, header);
+    this->uart->println("[SOCKET/MESSAGE]" + header);
+
+    // The session is reported as [SOCKET/CLOSED] on the next loop if the message was cut short
+    session->forwardMessage(this->uart, buffer, sizeof(buffer), length, binary, true);
+}
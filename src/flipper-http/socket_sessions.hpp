@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "uart.hpp"
+#include "websocket.hpp"
+
+#define SOCKET_MAX_SESSIONS 4 // Number of WebSockets that can be open at once
+#define SOCKET_MAX_HEADERS 10 // Number of custom headers sent with the upgrade request
+
+// WebSockets that stay open in the background while other commands run. Every
+// inbound message is prefixed by its session id, and text messages end with a newline:
+// [SOCKET/MESSAGE]{"id":0,"length":5}
+// hello
+// [SOCKET/MESSAGE]{"id":1,"length":3,"binary":true}
+// <3 raw bytes>
+// A message the connection drops in the middle of is padded with zeros to its
+// announced length and followed by an [ERROR] line, then [SOCKET/CLOSED].
+class SocketSessions
+{
+public:
+    SocketSessions(UART *uart);
+    ~SocketSessions();
+
+    // Connects to a ws:// or wss:// url, returns the session id or -1 on failure
+    int open(
+        const String &url,                    // URL to connect to
+        uint16_t port,                        // Port, 0 to use the one in the URL or the scheme's default
+        const char *headerKeys[] = nullptr,   // Array of header keys
+        const char *headerValues[] = nullptr, // Array of header values
+        int headerSize = 0,                   // Number of headers
+        uint32_t pingInterval = 20000,        // Keepalive ping interval in ms, 0 disables
+        uint32_t pongTimeout = 10000,         // Time in ms a pong may take
+        uint8_t deflateBits = 0,              // Window bits to offer permessage-deflate with, 0 disables
+        bool noContextTakeover = false        // Whether compression restarts with every message, saving the window memory
+    );
+
+    WebSocket *get(int id); // Returns an open session, nullptr if id is not one
+    bool close(int id);     // Closes a session, returns false if it was not open
+    void loop();            // Forwards one inbound message per session and keeps the sessions alive
+    bool active() const;    // Whether any session is open
+
+private:
+    void forward(int id); // Copies one inbound message of a session to UART
+    void closed(int id);  // Reports a session the server or a dead peer ended and frees it
+
+    UART *uart;                               // UART object to handle serial communication
+    WebSocket *sessions[SOCKET_MAX_SESSIONS]; // Sessions, indexed by id, nullptr when free
+};
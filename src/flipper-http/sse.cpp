@@ -0,0 +1,384 @@
+#include "sse.hpp"
+#include "certs.hpp"
+
+EventSource::EventSource(UART *uart)
+    : clientStream(&this->client), connection(&this->clientStream)
+{
+    this->uart = uart;
+    this->host[0] = '\0';
+    this->port = 0;
+    this->headerSize = 0;
+    this->phase = PHASE_CLOSED;
+    this->running = false;
+    this->sentAt = 0;
+    this->reconnectAt = 0;
+    this->retry = SSE_DEFAULT_RETRY;
+    this->lastEventId[0] = '\0';
+#ifndef BOARD_BW16
+    this->client.setCACert(root_ca);
+#else
+    this->client.setRootCA((unsigned char *)root_ca);
+#endif
+}
+
+EventSource::~EventSource()
+{
+    this->stop();
+}
+
+bool EventSource::begin(const char *url, const char *headerKeys[], const char *headerValues[], int headerSize)
+{
+    this->stop();
+
+    const char *path;
+    bool secure;
+    if (!httpSplitUrl(url, this->host, sizeof(this->host), &this->port, &path, &secure))
+    {
+        return false;
+    }
+    this->path = path;
+    this->headerSize = headerSize > SSE_MAX_HEADERS ? SSE_MAX_HEADERS : headerSize;
+    for (int i = 0; i < this->headerSize; i++)
+    {
+        this->headerKeys[i] = headerKeys[i];
+        this->headerValues[i] = headerValues[i];
+    }
+    this->lastEventId[0] = '\0';
+    this->retry = SSE_DEFAULT_RETRY;
+
+    // The first response is waited for, so [SSE/START] can report whether the stream opened
+    if (!this->open() || this->connection.readHeaders(this->parser, SSE_CONNECT_TIMEOUT) != 200)
+    {
+        this->connection.close();
+        this->phase = PHASE_CLOSED;
+        return false;
+    }
+    this->phase = PHASE_EVENTS;
+    this->running = true;
+    return true;
+}
+
+bool EventSource::open()
+{
+    this->connection.close();
+    this->phase = PHASE_CLOSED;
+
+    // A new stream starts with an empty event
+    this->state = STATE_FIELD;
+    this->field = FIELD_OTHER;
+    this->lastWasCR = false;
+    this->fieldLength = 0;
+    this->valueLength = 0;
+    this->eventLength = 0;
+    this->dataLength = 0;
+    this->hasData = false;
+    this->truncated = false;
+
+    const char *keys[SSE_MAX_HEADERS + 3];
+    const char *values[SSE_MAX_HEADERS + 3];
+    int count = 0;
+    for (int i = 0; i < this->headerSize; i++)
+    {
+        keys[count] = this->headerKeys[i].c_str();
+        values[count] = this->headerValues[i].c_str();
+        count++;
+    }
+    keys[count] = "Accept";
+    values[count] = "text/event-stream";
+    count++;
+    keys[count] = "Cache-Control";
+    values[count] = "no-cache";
+    count++;
+    if (this->lastEventId[0] != '\0')
+    {
+        keys[count] = "Last-Event-ID";
+        values[count] = this->lastEventId;
+        count++;
+    }
+
+    size_t headLength;
+    char *head = httpNewRequestHead(headLength, "GET", this->host, this->port, this->path.c_str(), keys, values, count, -2, true);
+    bool sent = head && this->connection.open(this->host, this->port) && this->connection.send((const uint8_t *)head, headLength);
+    free(head);
+    if (!sent)
+    {
+        this->connection.close();
+        return false;
+    }
+    this->parser.reset();
+    this->phase = PHASE_HEADERS;
+    this->sentAt = millis();
+    return true;
+}
+
+void EventSource::drop()
+{
+    this->connection.close();
+    this->phase = PHASE_CLOSED;
+    this->reconnectAt = millis() + this->retry;
+}
+
+void EventSource::loop()
+{
+    if (!this->running)
+    {
+        return;
+    }
+    if (this->phase == PHASE_CLOSED)
+    {
+        if ((long)(millis() - this->reconnectAt) >= 0 && !this->open())
+        {
+            this->reconnectAt = millis() + this->retry;
+        }
+        return;
+    }
+    if (this->phase == PHASE_HEADERS)
+    {
+        // A zero timeout reads what has arrived and keeps the parser's place until the next call
+        int status = this->connection.readHeaders(this->parser, 0);
+        if (status < 0)
+        {
+            if (this->parser.failed() || !this->clientStream.connected() || millis() - this->sentAt > SSE_CONNECT_TIMEOUT)
+            {
+                this->drop();
+            }
+            return;
+        }
+        if (status != 200)
+        {
+            this->drop();
+            return;
+        }
+        this->phase = PHASE_EVENTS;
+    }
+
+    // Parse whatever has arrived without waiting for more
+    const uint8_t *bytes;
+    int received;
+    while ((received = this->connection.readBody(this->parser, bytes, 0)) > 0)
+    {
+        this->feed(bytes, received);
+    }
+    if (received == 0 || this->parser.failed() || !this->clientStream.connected())
+    {
+        // The stream ended or dropped, reopen it after the retry delay
+        this->drop();
+    }
+}
+
+void EventSource::stop()
+{
+    this->running = false;
+    if (this->phase != PHASE_CLOSED)
+    {
+        this->connection.close();
+        this->phase = PHASE_CLOSED;
+    }
+}
+
+void EventSource::feed(const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        this->process((char)data[i]);
+    }
+}
+
+void EventSource::process(char c)
+{
+    // Lines end with CRLF, LF or CR
+    if (c == '\n' && this->lastWasCR)
+    {
+        this->lastWasCR = false;
+        return;
+    }
+    this->lastWasCR = c == '\r';
+    if (c == '\r' || c == '\n')
+    {
+        this->endLine();
+        return;
+    }
+
+    switch (this->state)
+    {
+    case STATE_FIELD:
+        if (c == ':')
+        {
+            if (this->fieldLength == 0)
+            {
+                this->state = STATE_IGNORE; // comment line
+            }
+            else
+            {
+                this->selectField();
+                this->state = STATE_VALUE_START;
+            }
+        }
+        else if (this->fieldLength < SSE_FIELD_SIZE)
+        {
+            // One byte past the buffer marks a name too long to be a known field
+            if (this->fieldLength < SSE_FIELD_SIZE - 1)
+            {
+                this->fieldName[this->fieldLength] = c;
+            }
+            this->fieldLength++;
+        }
+        break;
+    case STATE_VALUE_START:
+        this->state = this->field == FIELD_OTHER ? STATE_IGNORE : STATE_VALUE;
+        if (c == ' ' || this->state == STATE_IGNORE)
+        {
+            break; // a single leading space is not part of the value
+        }
+        // fall through
+    case STATE_VALUE:
+        switch (this->field)
+        {
+        case FIELD_EVENT:
+            if (this->eventLength < SSE_EVENT_SIZE - 1)
+            {
+                this->eventType[this->eventLength++] = c;
+            }
+            break;
+        case FIELD_DATA:
+            this->appendData(c);
+            break;
+        case FIELD_ID:
+            if (this->valueLength < SSE_ID_SIZE - 1)
+            {
+                this->pendingId[this->valueLength++] = c;
+            }
+            break;
+        case FIELD_RETRY:
+            if (c >= '0' && c <= '9')
+            {
+                this->pendingRetry = this->pendingRetry * 10 + (c - '0');
+                this->valueLength++;
+            }
+            else
+            {
+                this->pendingRetryValid = false;
+            }
+            break;
+        case FIELD_OTHER:
+            break;
+        }
+        break;
+    case STATE_IGNORE:
+        break;
+    }
+}
+
+void EventSource::selectField()
+{
+    this->field = FIELD_OTHER;
+    this->valueLength = 0;
+    if (this->fieldLength >= SSE_FIELD_SIZE)
+    {
+        return;
+    }
+    this->fieldName[this->fieldLength] = '\0';
+    if (strcmp(this->fieldName, "event") == 0)
+    {
+        this->field = FIELD_EVENT;
+        this->eventLength = 0;
+    }
+    else if (strcmp(this->fieldName, "data") == 0)
+    {
+        // Data lines are joined with a newline, added when the next one starts so the last has none
+        this->field = FIELD_DATA;
+        if (this->hasData)
+        {
+            this->appendData('\n');
+        }
+        this->hasData = true;
+    }
+    else if (strcmp(this->fieldName, "id") == 0)
+    {
+        this->field = FIELD_ID;
+    }
+    else if (strcmp(this->fieldName, "retry") == 0)
+    {
+        this->field = FIELD_RETRY;
+        this->pendingRetry = 0;
+        this->pendingRetryValid = true;
+    }
+}
+
+void EventSource::appendData(char c)
+{
+    if (this->dataLength < SSE_DATA_SIZE - 1)
+    {
+        this->data[this->dataLength++] = c;
+    }
+    else
+    {
+        this->truncated = true;
+    }
+}
+
+void EventSource::endLine()
+{
+    if (this->state == STATE_FIELD)
+    {
+        if (this->fieldLength == 0)
+        {
+            this->dispatch(); // a blank line ends the event
+            return;
+        }
+        this->selectField(); // a line without ':' is a field with an empty value
+        this->state = STATE_VALUE;
+    }
+
+    if (this->state != STATE_IGNORE)
+    {
+        switch (this->field)
+        {
+        case FIELD_ID:
+            memcpy(this->lastEventId, this->pendingId, this->valueLength);
+            this->lastEventId[this->valueLength] = '\0';
+            break;
+        case FIELD_RETRY:
+            if (this->pendingRetryValid && this->valueLength > 0)
+            {
+                this->retry = this->pendingRetry;
+            }
+            break;
+        case FIELD_DATA:
+        case FIELD_EVENT:
+        case FIELD_OTHER:
+            break;
+        }
+    }
+
+    this->state = STATE_FIELD;
+    this->field = FIELD_OTHER;
+    this->fieldLength = 0;
+    this->valueLength = 0;
+}
+
+void EventSource::dispatch()
+{
+    if (this->hasData)
+    {
+        this->data[this->dataLength] = '\0';
+        this->eventType[this->eventLength] = '\0';
+
+        JsonDocument doc;
+        doc["event"] = this->eventLength > 0 ? this->eventType : "message";
+        doc["id"] = this->lastEventId;
+        doc["data"] = this->data;
+        if (this->truncated)
+        {
+            doc["truncated"] = true;
+        }
+        String output;
+        serializeJson(doc, output);
+        this->uart->println("[SSE/EVENT]" + output);
+    }
+
+    this->eventLength = 0;
+    this->dataLength = 0;
+    this->hasData = false;
+    this->truncated = false;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "uart.hpp"
+#include "http.hpp"
+
+#define SSE_MAX_HEADERS 10        // Caller headers sent with the stream request
+#define SSE_FIELD_SIZE 8          // Longest field name kept ("event", "data", "id", "retry")
+#define SSE_EVENT_SIZE 32         // Longest event type kept
+#define SSE_ID_SIZE 64            // Longest event id kept
+#define SSE_DATA_SIZE 1024        // Event data kept per event, longer data is truncated
+#define SSE_DEFAULT_RETRY 3000    // Reconnect delay (ms) until the server sends "retry:"
+#define SSE_CONNECT_TIMEOUT 10000 // Time (ms) to wait for the response headers
+
+// Server-Sent Events client: keeps a text/event-stream response open, parses
+// its fields incrementally and writes each event over UART as one line:
+// [SSE/EVENT]{"event":"message","id":"42","data":"..."}, with "truncated":true
+// when the data didn't fit. Driven from the main loop, so commands keep working
+// while the stream is open. Dropped connections are reopened with Last-Event-ID
+// after the retry delay.
+class EventSource
+{
+public:
+    EventSource(UART *uart);
+    ~EventSource();
+
+    bool begin(const char *url, const char *headerKeys[], const char *headerValues[], int headerSize); // Opens the stream, returns false if the first connection fails
+    void loop();                                                                                      // Forwards any events that arrived and reconnects when it is time, without waiting
+    void stop();                                                                                      // Closes the stream
+
+private:
+    enum State
+    {
+        STATE_FIELD,       // Reading a field name
+        STATE_VALUE_START, // After ':', an optional space follows
+        STATE_VALUE,       // Reading a field value
+        STATE_IGNORE,      // Inside a comment or an unknown field
+    };
+
+    enum Field
+    {
+        FIELD_OTHER,
+        FIELD_EVENT,
+        FIELD_DATA,
+        FIELD_ID,
+        FIELD_RETRY,
+    };
+
+    enum Phase
+    {
+        PHASE_CLOSED,  // Waiting for reconnectAt
+        PHASE_HEADERS, // Request sent, waiting for the status line and headers
+        PHASE_EVENTS,  // Reading the event stream
+    };
+
+    bool open();                                 // Connects and sends the request, the headers are read by loop()
+    void drop();                                 // Closes the connection and schedules a reconnect
+    void feed(const uint8_t *data, size_t size); // Parses body bytes
+    void process(char c);                        // Advances the parser by one character
+    void selectField();                          // Picks the field named in the field buffer
+    void appendData(char c);                     // Adds a byte to the pending data, or marks it truncated
+    void endLine();                              // Commits the current field, a blank line dispatches the event
+    void dispatch();                             // Writes the pending event over UART
+
+    UART *uart; // UART object to handle serial communication
+#ifndef BOARD_BW16
+    WiFiClientSecure client; // Dedicated client so the stream survives other requests
+#else
+    WiFiSSLClient client; // Dedicated client so the stream survives other requests
+#endif
+    ClientStream clientStream;            // The client as seen by the HTTP core
+    HttpConnection connection;            // Connection the events arrive on
+    HttpResponseParser parser;            // Parses the response around the event stream
+    char host[HTTP_CORE_HOST_SIZE];       // Host of the stream
+    uint16_t port;                        // Port of the stream
+    String path;                          // Path of the stream
+    String headerKeys[SSE_MAX_HEADERS];   // Caller header keys, sent on every reconnect
+    String headerValues[SSE_MAX_HEADERS]; // Caller header values, sent on every reconnect
+    int headerSize;                       // Number of caller headers
+    Phase phase;                          // Part of the exchange in progress
+    bool running;                         // Whether begin() succeeded and stop() wasn't called
+    unsigned long sentAt;                 // millis() when the request was sent
+    unsigned long reconnectAt;            // millis() when a dropped stream is reopened
+    unsigned long retry;                  // Reconnect delay in ms
+
+    State state;                    // Current parser state
+    Field field;                    // Field being read
+    bool lastWasCR;                 // Whether the previous character was '\r' (CRLF counts as one line end)
+    char fieldName[SSE_FIELD_SIZE]; // Field name read so far
+    size_t fieldLength;             // Number of bytes in the field name
+    size_t valueLength;             // Number of bytes in the id or retry value being read
+    char eventType[SSE_EVENT_SIZE]; // Event type of the pending event
+    size_t eventLength;             // Number of bytes in eventType
+    char lastEventId[SSE_ID_SIZE];  // Last event id, sent as Last-Event-ID on reconnect
+    char pendingId[SSE_ID_SIZE];    // Id field being read
+    unsigned long pendingRetry;     // Retry field being read
+    bool pendingRetryValid;         // Whether the retry field is all digits so far
+    char data[SSE_DATA_SIZE];       // Data of the pending event
+    size_t dataLength;              // Number of bytes in data
+    bool hasData;                   // Whether the pending event has a data field
+    bool truncated;                 // Whether data was cut to fit
+};
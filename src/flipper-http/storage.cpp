@@ -127,3 +127,37 @@ bool StorageManager::write(const char *filename, const char *data)
     return true;
 #endif
 }
+
+#ifndef BOARD_BW16
+File StorageManager::open(const char *filename, const char *mode)
+{
+#if defined(BOARD_PICO_W) || defined(BOARD_PICO_2W) || defined(BOARD_VGM) || defined(BOARD_PICOCALC_W) || defined(BOARD_PICOCALC_2W)
+    return LittleFS.open(filename, mode);
+#else
+    return SPIFFS.open(filename, mode);
+#endif
+}
+
+bool StorageManager::remove(const char *filename)
+{
+#if defined(BOARD_PICO_W) || defined(BOARD_PICO_2W) || defined(BOARD_VGM) || defined(BOARD_PICOCALC_W) || defined(BOARD_PICOCALC_2W)
+    return LittleFS.remove(filename);
+#else
+    return SPIFFS.remove(filename);
+#endif
+}
+
+size_t StorageManager::freeSpace()
+{
+#if defined(BOARD_PICO_W) || defined(BOARD_PICO_2W) || defined(BOARD_VGM) || defined(BOARD_PICOCALC_W) || defined(BOARD_PICOCALC_2W)
+    FSInfo info;
+    if (!LittleFS.info(info))
+    {
+        return 0;
+    }
+    return info.totalBytes - info.usedBytes;
+#else
+    return SPIFFS.totalBytes() - SPIFFS.usedBytes();
+#endif
+}
+#endif
@@ -17,4 +17,9 @@ public:
     String read(const char *filename);
     bool serialize(JsonDocument &doc, const char *filename);
     bool write(const char *filename, const char *data);
+#ifndef BOARD_BW16
+    File open(const char *filename, const char *mode); // Opens a file for streaming reads ("r") or writes ("w")
+    bool remove(const char *filename);
+    size_t freeSpace(); // Bytes left on the file system
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "tcp_tunnel.hpp"
+
+void TcpRing::push(uint8_t c)
+{
+    this->buffer[(this->head + this->length) % TCP_RING_SIZE] = c;
+    this->length++;
+}
+
+size_t TcpRing::peek(const uint8_t *&data) const
+{
+    data = this->buffer + this->head;
+    size_t contiguous = TCP_RING_SIZE - this->head;
+    return this->length < contiguous ? this->length : contiguous;
+}
+
+size_t TcpRing::reserve(uint8_t *&data)
+{
+    size_t tail = (this->head + this->length) % TCP_RING_SIZE;
+    data = this->buffer + tail;
+    if (this->length == TCP_RING_SIZE)
+    {
+        return 0;
+    }
+    return tail >= this->head ? TCP_RING_SIZE - tail : this->head - tail;
+}
+
+void TcpRing::consume(size_t count)
+{
+    this->head = (this->head + count) % TCP_RING_SIZE;
+    this->length -= count;
+}
+
+void TcpRing::commit(size_t count)
+{
+    this->length += count;
+}
+
+TcpTunnel::TcpTunnel(UART *uart)
+{
+    this->uart = uart;
+    this->client = nullptr;
+    this->escape[0] = '\0';
+    this->escapeLength = 0;
+    this->escapeMatched = 0;
+    this->escaped = false;
+}
+
+TcpTunnel::~TcpTunnel()
+{
+    this->close();
+}
+
+bool TcpTunnel::open(const char *host, uint16_t port, Client *secureClient)
+{
+    this->close();
+    this->client = secureClient ? secureClient : &this->plainClient;
+    return this->client->connect(host, port);
+}
+
+void TcpTunnel::close()
+{
+    if (this->client)
+    {
+        this->client->stop();
+        this->client = nullptr;
+    }
+}
+
+void TcpTunnel::fromUart(uint8_t c)
+{
+    while (true)
+    {
+        if (c == (uint8_t)this->escape[this->escapeMatched])
+        {
+            // Hold the byte back until it is clear whether the escape sequence continues
+            if (++this->escapeMatched == this->escapeLength)
+            {
+                this->escaped = true;
+            }
+            return;
+        }
+        if (this->escapeMatched == 0)
+        {
+            this->upstream.push(c);
+            return;
+        }
+
+        // The held bytes were data after all: release them, keeping the longest part that could still start the escape
+        size_t keep = this->escapeMatched - 1;
+        while (keep > 0 && memcmp(this->escape, this->escape + this->escapeMatched - keep, keep) != 0)
+        {
+            keep--;
+        }
+        for (size_t i = 0; i < this->escapeMatched - keep; i++)
+        {
+            this->upstream.push(this->escape[i]);
+        }
+        this->escapeMatched = keep;
+    }
+}
+
+bool TcpTunnel::flushToSocket()
+{
+    const uint8_t *data;
+    size_t length;
+    while ((length = this->upstream.peek(data)) > 0)
+    {
+        size_t written = this->client->write(data, length);
+        if (written == 0)
+        {
+            return false;
+        }
+        this->upstream.consume(written);
+    }
+    return true;
+}
+
+void TcpTunnel::run(const char *escape, uint32_t idleFlush)
+{
+    if (!this->client)
+    {
+        return;
+    }
+    snprintf(this->escape, sizeof(this->escape), "%s", escape && escape[0] ? escape : TCP_DEFAULT_ESCAPE);
+    this->escapeLength = strlen(this->escape);
+    this->escapeMatched = 0;
+    this->escaped = false;
+
+    unsigned long lastUartByte = millis();
+    while (!this->escaped)
+    {
+        bool busy = false;
+
+        // UART to ring. Never read past a possible end of the escape sequence,
+        // so the bytes that follow it are left for the command loop.
+        size_t avail = this->uart->available();
+        if (avail > 0 && this->upstream.space() > TCP_ESCAPE_SIZE)
+        {
+            uint8_t buf[TCP_ESCAPE_SIZE];
+            size_t toRead = this->escapeLength - this->escapeMatched;
+            if (toRead > avail)
+                toRead = avail;
+            if (toRead > this->upstream.space() - TCP_ESCAPE_SIZE)
+                toRead = this->upstream.space() - TCP_ESCAPE_SIZE;
+            size_t bytesRead = this->uart->readBytes(buf, (uint8_t)toRead);
+            for (size_t i = 0; i < bytesRead && !this->escaped; i++)
+            {
+                this->fromUart(buf[i]);
+            }
+            lastUartByte = millis();
+            busy = true;
+        }
+
+        // Ring to socket once the UART goes quiet or enough is buffered, instead of per line
+        if (this->upstream.size() > 0 &&
+            (this->upstream.size() >= TCP_FLUSH_SIZE || millis() - lastUartByte >= idleFlush || this->escaped))
+        {
+            if (!this->flushToSocket())
+            {
+                break;
+            }
+            busy = true;
+        }
+
+        // Socket to ring
+        int socketAvail = this->client->available();
+        if (socketAvail > 0)
+        {
+            uint8_t *space;
+            size_t room = this->downstream.reserve(space);
+            if (room > 0)
+            {
+                int received = this->client->read(space, (size_t)socketAvail < room ? (size_t)socketAvail : room);
+                if (received > 0)
+                {
+                    this->downstream.commit(received);
+                    busy = true;
+                }
+            }
+        }
+
+        // Ring to UART
+        const uint8_t *data;
+        size_t length = this->downstream.peek(data);
+        if (length > 0)
+        {
+            this->uart->write(data, length);
+            this->downstream.consume(length);
+            busy = true;
+        }
+
+        // The server closed and everything it sent has been delivered
+        if (!busy && !this->client->connected() && this->client->available() == 0)
+        {
+            break;
+        }
+        if (!busy)
+        {
+            delay(1);
+        }
+    }
+}
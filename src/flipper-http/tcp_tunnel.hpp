@@ -0,0 +1,59 @@
+#pragma once
+#include <Arduino.h>
+#include "boards.hpp"
+#include "wifi_utils.hpp"
+#include "uart.hpp"
+
+#define TCP_RING_SIZE 1024              // Bytes buffered in each direction
+#define TCP_FLUSH_SIZE 512              // Buffered UART bytes sent without waiting for the line to go idle
+#define TCP_IDLE_FLUSH 3                // Default UART silence (ms) after which buffered bytes are sent
+#define TCP_ESCAPE_SIZE 16              // Longest escape sequence
+#define TCP_DEFAULT_ESCAPE "[TCP/STOP]" // Escape sequence used when none is given
+
+// Fixed-size byte ring between the UART and the socket
+class TcpRing
+{
+public:
+    TcpRing() : head(0), length(0) {}
+
+    size_t size() const { return this->length; }                 // Bytes buffered
+    size_t space() const { return TCP_RING_SIZE - this->length; } // Bytes that still fit
+    void push(uint8_t c);                                         // Adds a byte, the caller checks space() first
+    size_t peek(const uint8_t *&data) const;                      // Points data at the oldest contiguous bytes, returns their count
+    size_t reserve(uint8_t *&data);                               // Points data at the free contiguous bytes, returns their count
+    void consume(size_t count);                                   // Drops the oldest count bytes
+    void commit(size_t count);                                    // Adds count bytes written through reserve()
+
+private:
+    uint8_t buffer[TCP_RING_SIZE]; // Ring storage
+    size_t head;                   // Index of the oldest byte
+    size_t length;                 // Bytes buffered
+};
+
+// Transparent byte pipe between the UART and a TCP or TLS connection. UART
+// bytes are sent once the line goes idle (or the buffer fills) instead of per
+// line, and the session ends on an escape sequence or when the server closes.
+class TcpTunnel
+{
+public:
+    TcpTunnel(UART *uart);
+    ~TcpTunnel();
+
+    bool open(const char *host, uint16_t port, Client *secureClient = nullptr); // Connects, over TLS when secureClient is given
+    void run(const char *escape, uint32_t idleFlush);                           // Pipes bytes until the escape sequence arrives or the connection closes
+    void close();                                                               // Closes the connection
+
+private:
+    void fromUart(uint8_t c); // Passes a UART byte through the escape matcher
+    bool flushToSocket();     // Writes buffered UART bytes, returns false if the connection failed
+
+    UART *uart;                       // UART object to handle serial communication
+    WiFiClient plainClient;           // Client for plain TCP
+    Client *client;                   // The client in use
+    TcpRing upstream;                 // UART bytes waiting for the socket
+    TcpRing downstream;               // Socket bytes waiting for the UART
+    char escape[TCP_ESCAPE_SIZE + 1]; // Escape sequence
+    size_t escapeLength;              // Length of escape
+    size_t escapeMatched;             // Escape bytes matched and held back so far
+    bool escaped;                     // Whether the escape sequence arrived
+};
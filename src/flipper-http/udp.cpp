@@ -0,0 +1,115 @@
+#include "udp.hpp"
+
+UdpSocket::UdpSocket(UART *uart)
+{
+    this->uart = uart;
+    this->isBound = false;
+    this->binary = false;
+}
+
+UdpSocket::~UdpSocket()
+{
+    this->close();
+}
+
+bool UdpSocket::bind(uint16_t port, bool binary)
+{
+    this->close();
+    if (!this->udp.begin(port))
+    {
+        return false;
+    }
+    this->isBound = true;
+    this->binary = binary;
+    return true;
+}
+
+void UdpSocket::close()
+{
+    if (this->isBound)
+    {
+        this->udp.stop();
+        this->isBound = false;
+    }
+}
+
+bool UdpSocket::resolve(const char *host, IPAddress &ip)
+{
+    // Game traffic goes to the same peer every time, so only look it up once
+    if (this->cachedHost.length() > 0 && this->cachedHost == host)
+    {
+        ip = this->cachedIp;
+        return true;
+    }
+    if (!WiFi.hostByName(host, ip))
+    {
+        return false;
+    }
+    this->cachedHost = host;
+    this->cachedIp = ip;
+    return true;
+}
+
+bool UdpSocket::send(const char *host, uint16_t port, const uint8_t *data, size_t length)
+{
+    IPAddress ip;
+    if (!this->isBound || length > UDP_MAX_PACKET || !this->resolve(host, ip))
+    {
+        return false;
+    }
+    if (!this->udp.beginPacket(ip, port))
+    {
+        return false;
+    }
+    this->udp.write(data, length);
+    return this->udp.endPacket();
+}
+
+void UdpSocket::loop()
+{
+    if (!this->isBound)
+    {
+        return;
+    }
+    for (int i = 0; i < UDP_MAX_PER_LOOP; i++)
+    {
+        int size = this->udp.parsePacket();
+        if (size <= 0)
+        {
+            return;
+        }
+        int length = this->udp.read(this->buffer, UDP_MAX_PACKET);
+        if (length < 0)
+        {
+            length = 0;
+        }
+
+        JsonDocument doc;
+#ifndef BOARD_BW16
+        doc["host"] = this->udp.remoteIP().toString();
+#else
+        doc["host"] = this->udp.remoteIP().get_address();
+#endif
+        doc["port"] = this->udp.remotePort();
+        if (size > UDP_MAX_PACKET)
+        {
+            doc["truncated"] = true; // only the first UDP_MAX_PACKET bytes are forwarded, the rest is dropped
+        }
+        if (this->binary)
+        {
+            doc["length"] = length;
+        }
+        else
+        {
+            this->buffer[length] = '\0';
+            doc["data"] = (const char *)this->buffer;
+        }
+        String output;
+        serializeJson(doc, output);
+        this->uart->println("[UDP/RECV]" + output);
+        if (this->binary)
+        {
+            this->uart->write(this->buffer, length);
+        }
+    }
+}
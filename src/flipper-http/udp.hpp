@@ -0,0 +1,39 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFiUdp.h>
+#include "boards.hpp"
+#include "wifi_utils.hpp"
+#include "uart.hpp"
+
+#define UDP_MAX_PACKET 1472 // Largest datagram sent or forwarded whole (one Ethernet frame)
+#define UDP_MAX_PER_LOOP 4  // Datagrams forwarded per loop() call
+
+// UDP socket kept bound between commands. Received datagrams are written over UART as they arrive:
+// [UDP/RECV]{"host":"1.2.3.4","port":1234,"data":"..."}
+// or, in binary mode, as a length line followed by exactly that many raw bytes:
+// [UDP/RECV]{"host":"1.2.3.4","port":1234,"length":5}
+// A datagram longer than UDP_MAX_PACKET is cut to that length and marked "truncated":true
+class UdpSocket
+{
+public:
+    UdpSocket(UART *uart);
+    ~UdpSocket();
+
+    bool bind(uint16_t port, bool binary);                                         // Listens on port, returns false if it is unavailable
+    bool send(const char *host, uint16_t port, const uint8_t *data, size_t length); // Sends one datagram, returns false on failure
+    void loop();                                                                   // Forwards datagrams that arrived
+    void close();                                                                  // Stops listening
+    bool bound() const { return this->isBound; }                                   // Whether bind() succeeded
+
+private:
+    bool resolve(const char *host, IPAddress &ip); // Looks up host, reusing the last answer
+
+    UART *uart;                         // UART object to handle serial communication
+    WiFiUDP udp;                        // Socket used for both directions
+    bool isBound;                       // Whether the socket is listening
+    bool binary;                        // Whether received datagrams are forwarded as raw bytes
+    String cachedHost;                  // Last host looked up
+    IPAddress cachedIp;                 // Address of cachedHost
+    uint8_t buffer[UDP_MAX_PACKET + 1]; // Received datagram, plus a terminator
+};
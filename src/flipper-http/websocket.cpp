@@ -1,20 +1,200 @@
 #include "websocket.hpp"
+#include "certs.hpp"
 
-#define MAX_WS_CHUNK_SIZE 128
+// Frame opcodes (RFC 6455)
+#define WS_OPCODE_CONTINUATION 0x0
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+#define WS_RSV1 0x40 // Set on the first frame of a compressed message (RFC 7692)
+
+// Base64-encodes size bytes into output, which must hold 4 * ((size + 2) / 3) + 1 bytes
+static void wsBase64(const uint8_t *data, size_t size, char *output)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < size; i += 3)
+    {
+        uint32_t group = (uint32_t)data[i] << 16;
+        if (i + 1 < size)
+            group |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < size)
+            group |= data[i + 2];
+        output[o++] = alphabet[(group >> 18) & 0x3F];
+        output[o++] = alphabet[(group >> 12) & 0x3F];
+        output[o++] = i + 1 < size ? alphabet[(group >> 6) & 0x3F] : '=';
+        output[o++] = i + 2 < size ? alphabet[group & 0x3F] : '=';
+    }
+    output[o] = '\0';
+}
+
+static uint32_t wsRotate(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// SHA-1 of size bytes into digest, only used to check the server's Sec-WebSocket-Accept
+static void wsSha1(const uint8_t *data, size_t size, uint8_t digest[20])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint64_t bits = (uint64_t)size * 8;
+    size_t total = ((size + 8) / 64 + 1) * 64; // data, 0x80, zero padding and the 64-bit length
+    for (size_t offset = 0; offset < total; offset += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = 0;
+            for (int j = 0; j < 4; j++)
+            {
+                size_t index = offset + i * 4 + j;
+                uint8_t byte;
+                if (index < size)
+                    byte = data[index];
+                else if (index == size)
+                    byte = 0x80;
+                else if (index >= total - 8)
+                    byte = (uint8_t)(bits >> (8 * (total - 1 - index)));
+                else
+                    byte = 0;
+                w[i] = (w[i] << 8) | byte;
+            }
+        }
+        for (int i = 16; i < 80; i++)
+        {
+            w[i] = wsRotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = wsRotate(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = wsRotate(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 20; i++)
+    {
+        digest[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
 
 WebSocket::WebSocket()
 {
-    this->ws_client = nullptr;
+    this->secureClient = nullptr;
+    this->plainClient = nullptr;
+    this->client = nullptr;
+    this->connected = false;
+    this->remaining = 0;
+    this->sending = false;
+    this->fragments = nullptr;
+    this->fragmentsLength = 0;
+    this->message = nullptr;
+    this->messageLength = 0;
+    this->pingInterval = 0;
+    this->pongTimeout = 0;
+    this->pingSentAt = 0;
+    this->pingPending = false;
+    this->rtt = 0;
+    this->rttReady = false;
+    this->queueHead = 0;
+    this->queueCount = 0;
+    this->deflateBits = 0;
+    this->deflateNoContextTakeover = false;
+    this->coalesceWindow = 0;
+    this->coalesceThreshold = WS_COALESCE_SIZE;
+    this->queuedAt = 0;
+    this->queuedBytes = 0;
+    this->bursting = false;
+    this->burst = nullptr;
+    this->burstLength = 0;
+    this->inflater = nullptr;
+    this->deflater = nullptr;
+    this->fragmentsCompressed = false;
 }
 
 WebSocket::~WebSocket()
 {
-    if (this->ws_client)
+    this->stop();
+    delete this->secureClient;
+    delete this->plainClient;
+}
+
+bool WebSocket::open(const char *serverName, uint16_t port, bool secure)
+{
+    if (!secure)
     {
-        this->ws_client->stop();
-        delete this->ws_client;
-        this->ws_client = nullptr;
+        if (!this->plainClient)
+        {
+            this->plainClient = new WiFiClient();
+            if (!this->plainClient)
+            {
+                return false;
+            }
+        }
+        this->client = this->plainClient;
+        return this->client->connect(serverName, port);
     }
+
+    if (!this->secureClient)
+    {
+#ifndef BOARD_BW16
+        this->secureClient = new WiFiClientSecure();
+#else
+        this->secureClient = new WiFiSSLClient();
+#endif
+        if (!this->secureClient)
+        {
+            return false;
+        }
+    }
+    this->client = this->secureClient;
+#ifndef BOARD_BW16
+    // Every connect tries with verification first, so a host is never downgraded for good
+    this->secureClient->setCACert(root_ca);
+    if (this->client->connect(serverName, port))
+    {
+        return true;
+    }
+    // certification failed? retry without SSL verification
+    this->secureClient->setInsecure();
+    bool opened = this->client->connect(serverName, port);
+    this->secureClient->setCACert(root_ca);
+    return opened;
+#else
+    this->secureClient->setRootCA((unsigned char *)root_ca);
+    return this->client->connect(serverName, port);
+#endif
 }
 
 bool WebSocket::connect(
@@ -23,80 +203,769 @@ bool WebSocket::connect(
     const char *path,
     const char *headerKeys[],
     const char *headerValues[],
-    int headerSize)
+    int headerSize,
+    bool secure)
 {
-    this->ws_client = new WebSocketClient(this->wifi_client, serverName, port);
+    this->stop();
+    if (!this->open(serverName, port, secure))
+    {
+        return false;
+    }
 
-    // Send headers, if any
-    for (int i = 0; i < headerSize; i++)
+    uint8_t nonce[16];
+    for (size_t i = 0; i < sizeof(nonce); i++)
     {
-        this->ws_client->sendHeader(headerKeys[i], headerValues[i]);
+        nonce[i] = random(256);
     }
+    char key[25];
+    wsBase64(nonce, sizeof(nonce), key);
 
-    // Begin the WebSocket connection
-    this->ws_client->begin(path);
+    // The server proves it read the key by answering base64(SHA-1(key + GUID))
+    char keyed[24 + 36 + 1];
+    snprintf(keyed, sizeof(keyed), "%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11", key);
+    uint8_t digest[20];
+    wsSha1((const uint8_t *)keyed, strlen(keyed), digest);
+    char expected[29];
+    wsBase64(digest, sizeof(digest), expected);
 
-    return this->ws_client->connected();
+    char request[WS_HANDSHAKE_SIZE];
+    int length = snprintf(request, sizeof(request),
+                          "GET %s HTTP/1.1\r\nHost: %s:%u\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n",
+                          path, serverName, port, key);
+    for (int i = 0; i < headerSize && length > 0 && (size_t)length < sizeof(request); i++)
+    {
+        length += snprintf(request + length, sizeof(request) - length, "%s: %s\r\n", headerKeys[i], headerValues[i]);
+    }
+    if (this->deflateBits > 0 && length > 0 && (size_t)length < sizeof(request))
+    {
+        // Ask the server for a window this board can afford to keep
+        length += snprintf(request + length, sizeof(request) - length,
+                           "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits=%u; server_max_window_bits=%u%s\r\n",
+                           this->deflateBits, this->deflateBits,
+                           this->deflateNoContextTakeover ? "; client_no_context_takeover; server_no_context_takeover" : "");
+    }
+    if (length > 0 && (size_t)length < sizeof(request))
+    {
+        length += snprintf(request + length, sizeof(request) - length, "\r\n");
+    }
+    if (length <= 0 || (size_t)length >= sizeof(request) ||
+        this->client->write((const uint8_t *)request, length) != (size_t)length)
+    {
+        this->client->stop();
+        return false;
+    }
+
+    // The status line must be 101 with the expected Sec-WebSocket-Accept, the only other header that matters is the accepted extension
+    char line[256];
+    size_t lineLength = 0;
+    bool statusLine = true;
+    bool upgraded = false;
+    bool accepted = false;
+    while (true)
+    {
+        uint8_t c;
+        if (!this->readExact(&c, 1, WS_HANDSHAKE_TIMEOUT))
+        {
+            this->client->stop();
+            return false;
+        }
+        if (c == '\r')
+        {
+            continue;
+        }
+        if (c != '\n')
+        {
+            if (lineLength < sizeof(line) - 1)
+            {
+                line[lineLength++] = c;
+            }
+            continue;
+        }
+        line[lineLength] = '\0';
+        if (lineLength == 0)
+        {
+            break;
+        }
+        if (statusLine)
+        {
+            upgraded = strncmp(line, "HTTP/1.1 101", 12) == 0;
+            statusLine = false;
+        }
+        else if (strncasecmp(line, "Sec-WebSocket-Accept:", 21) == 0)
+        {
+            const char *value = line + 21;
+            while (*value == ' ' || *value == '\t')
+            {
+                value++;
+            }
+            size_t valueLength = strlen(value);
+            while (valueLength > 0 && (value[valueLength - 1] == ' ' || value[valueLength - 1] == '\t'))
+            {
+                valueLength--;
+            }
+            accepted = valueLength == strlen(expected) && strncmp(value, expected, valueLength) == 0;
+        }
+        else if (this->deflateBits > 0 && strncasecmp(line, "Sec-WebSocket-Extensions:", 25) == 0 && !this->negotiate(line + 25))
+        {
+            upgraded = false;
+        }
+        lineLength = 0;
+    }
+    if (!upgraded || !accepted)
+    {
+        this->client->stop();
+        return false;
+    }
+    this->connected = true;
+    this->remaining = 0;
+    this->sending = false;
+    this->pingSentAt = millis();
+    this->pingPending = false;
+    this->rttReady = false;
+    return true;
 }
 
 bool WebSocket::isConnected()
 {
-    return this->ws_client && this->ws_client->connected();
+    return this->connected && this->client && this->client->connected();
+}
+
+void WebSocket::setDeflate(uint8_t windowBits, bool noContextTakeover)
+{
+    if (windowBits != 0 && windowBits < DEFLATE_MIN_WINDOW_BITS)
+    {
+        windowBits = DEFLATE_MIN_WINDOW_BITS;
+    }
+    if (windowBits > DEFLATE_MAX_WINDOW_BITS)
+    {
+        windowBits = DEFLATE_MAX_WINDOW_BITS;
+    }
+    this->deflateBits = windowBits;
+    this->deflateNoContextTakeover = noContextTakeover;
+}
+
+bool WebSocket::compressing() const
+{
+    return this->deflater != nullptr;
+}
+
+// Reads the value of a window bits parameter, which may be quoted
+static uint8_t wsWindowBits(const char *parameters, const char *name, uint8_t fallback)
+{
+    const char *value = strstr(parameters, name);
+    if (!value)
+    {
+        return fallback;
+    }
+    value += strlen(name);
+    if (*value == '"')
+    {
+        value++;
+    }
+    int bits = atoi(value);
+    return bits >= DEFLATE_MIN_WINDOW_BITS && bits <= DEFLATE_MAX_WINDOW_BITS ? bits : fallback;
+}
+
+bool WebSocket::negotiate(const char *parameters)
+{
+    if (!strstr(parameters, "permessage-deflate"))
+    {
+        return true;
+    }
+
+    // The server may shrink our window and may drop context takeover in either direction
+    uint8_t serverBits = wsWindowBits(parameters, "server_max_window_bits=", DEFLATE_MAX_WINDOW_BITS);
+    uint8_t clientBits = wsWindowBits(parameters, "client_max_window_bits=", this->deflateBits);
+    if (clientBits > this->deflateBits)
+    {
+        clientBits = this->deflateBits;
+    }
+    bool serverTakeover = !strstr(parameters, "server_no_context_takeover");
+    bool clientTakeover = !this->deflateNoContextTakeover && !strstr(parameters, "client_no_context_takeover");
+
+    delete this->inflater;
+    delete this->deflater;
+    this->inflater = new Inflater(serverBits, serverTakeover);
+    this->deflater = new Deflater(clientBits, clientTakeover);
+    return this->inflater && this->inflater->ready() && this->deflater && this->deflater->ready();
+}
+
+bool WebSocket::available()
+{
+    return this->connected && this->client->available() > 0;
 }
 
 void WebSocket::ping()
 {
-    if (this->ws_client && this->ws_client->connected())
+    if (!this->isConnected())
     {
-        this->ws_client->ping();
+        return;
     }
+    this->pingSentAt = millis();
+    uint8_t stamp[4] = {
+        (uint8_t)(this->pingSentAt >> 24),
+        (uint8_t)(this->pingSentAt >> 16),
+        (uint8_t)(this->pingSentAt >> 8),
+        (uint8_t)this->pingSentAt,
+    };
+    this->pingPending = this->sendFrame(WS_OPCODE_PING, stamp, sizeof(stamp));
 }
 
-String WebSocket::recv()
+void WebSocket::setKeepAlive(uint32_t interval, uint32_t timeout)
 {
-    if (this->ws_client && this->ws_client->connected())
+    this->pingInterval = interval;
+    this->pongTimeout = timeout;
+}
+
+bool WebSocket::queue(const String &message)
+{
+    if (this->queueFull())
+    {
+        return false;
+    }
+    if (this->queueCount == 0)
     {
-        if (this->ws_client->parseMessage() > 0)
+        this->queuedAt = millis();
+    }
+    this->outbound[(this->queueHead + this->queueCount) % WS_QUEUE_SIZE] = message;
+    this->queueCount++;
+    this->queuedBytes += message.length();
+    return true;
+}
+
+bool WebSocket::queueFull() const
+{
+    return this->queueCount == WS_QUEUE_SIZE;
+}
+
+void WebSocket::setCoalesce(uint32_t window, size_t threshold)
+{
+    // The burst buffer only exists while coalescing, without it frames are written one by one
+    if (window > 0 && !this->burst)
+    {
+        this->burst = (uint8_t *)malloc(WS_COALESCE_SIZE);
+    }
+    else if (window == 0 && this->burst)
+    {
+        free(this->burst);
+        this->burst = nullptr;
+    }
+    this->coalesceWindow = this->burst ? window : 0;
+    this->coalesceThreshold = threshold;
+}
+
+void WebSocket::sendQueued()
+{
+    this->send(this->outbound[this->queueHead]);
+    this->queuedBytes -= this->outbound[this->queueHead].length();
+    this->outbound[this->queueHead] = ""; // release the memory
+    this->queueHead = (this->queueHead + 1) % WS_QUEUE_SIZE;
+    this->queueCount--;
+}
+
+void WebSocket::flush()
+{
+    // When coalescing, the frames of all queued messages leave in as few writes as possible
+    this->bursting = this->coalesceWindow > 0;
+    while (this->queueCount > 0 && this->isConnected())
+    {
+        this->sendQueued();
+    }
+    this->bursting = false;
+    this->flushBurst();
+}
+
+bool WebSocket::transmit(const uint8_t *data, size_t length)
+{
+    if (!this->bursting)
+    {
+        return this->client->write(data, length) == length;
+    }
+    if (this->burstLength + length > WS_COALESCE_SIZE)
+    {
+        if (!this->flushBurst())
+        {
+            return false;
+        }
+        if (length > WS_COALESCE_SIZE)
         {
-            return this->ws_client->readString();
+            return this->client->write(data, length) == length;
         }
     }
-    return "";
+    memcpy(this->burst + this->burstLength, data, length);
+    this->burstLength += length;
+    return true;
 }
 
-void WebSocket::send(String &message)
+bool WebSocket::flushBurst()
+{
+    size_t length = this->burstLength;
+    this->burstLength = 0;
+    return length == 0 || (this->client && this->client->write(this->burst, length) == length);
+}
+
+bool WebSocket::service()
+{
+    if (!this->isConnected())
+    {
+        return false;
+    }
+    if (this->queueCount > 0)
+    {
+        if (this->coalesceWindow == 0)
+        {
+            this->sendQueued();
+        }
+        else if (this->queueFull() || this->queuedBytes >= this->coalesceThreshold ||
+                 millis() - this->queuedAt >= this->coalesceWindow)
+        {
+            this->flush(); // the oldest message waited long enough, or enough piled up
+        }
+    }
+    if (this->pingInterval == 0)
+    {
+        return true;
+    }
+    unsigned long now = millis();
+    if (this->pingPending)
+    {
+        // The main loop may have been busy elsewhere (a slow HTTP request, say) while the pong arrived,
+        // so a frame already waiting is read by recv() before the peer is given up on
+        if (now - this->pingSentAt > this->pongTimeout && this->client->available() < 2)
+        {
+            this->stop(); // dead peer
+            return false;
+        }
+    }
+    else if (now - this->pingSentAt >= this->pingInterval)
+    {
+        this->ping();
+    }
+    return true;
+}
+
+bool WebSocket::takeRtt(uint32_t &rtt)
 {
-    if (this->ws_client && this->ws_client->connected())
+    if (!this->rttReady)
     {
-        int totalLength = message.length();
+        return false;
+    }
+    rtt = this->rtt;
+    this->rttReady = false;
+    return true;
+}
 
-        if (totalLength <= MAX_WS_CHUNK_SIZE)
+bool WebSocket::readExact(uint8_t *buffer, size_t size, uint32_t timeout)
+{
+    size_t received = 0;
+    unsigned long start = millis();
+    while (received < size)
+    {
+        int available = this->client->available();
+        if (available > 0)
         {
-            // If message is small enough, send normally
-            this->ws_client->beginMessage(TYPE_TEXT);
-            this->ws_client->print(message);
-            this->ws_client->endMessage();
+            int count = this->client->read(buffer + received, size - received);
+            if (count > 0)
+            {
+                received += count;
+                start = millis();
+                continue;
+            }
+        }
+        if (!this->client->connected() || millis() - start > timeout)
+        {
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+void WebSocket::discard(size_t size)
+{
+    uint8_t scratch[64];
+    while (size > 0)
+    {
+        size_t count = size < sizeof(scratch) ? size : sizeof(scratch);
+        if (!this->readExact(scratch, count, WS_READ_TIMEOUT))
+        {
+            this->stop();
             return;
         }
+        size -= count;
+    }
+}
+
+void WebSocket::release()
+{
+    free(this->fragments);
+    this->fragments = nullptr;
+    this->fragmentsLength = 0;
+    free(this->message);
+    this->message = nullptr;
+    this->messageLength = 0;
+}
+
+void WebSocket::fail(uint16_t code)
+{
+    uint8_t payload[2] = {(uint8_t)(code >> 8), (uint8_t)(code & 0xFF)};
+    this->sendFrame(WS_OPCODE_CLOSE, payload, sizeof(payload));
+    this->connected = false;
+    this->stop();
+}
+
+bool WebSocket::appendFragment(uint64_t length)
+{
+    if (this->fragmentsLength + length > WS_MAX_MESSAGE)
+    {
+        this->fail(1009); // message too big
+        return false;
+    }
+    uint8_t *grown = (uint8_t *)realloc(this->fragments, this->fragmentsLength + length + 1);
+    if (!grown)
+    {
+        this->stop();
+        return false;
+    }
+    this->fragments = grown;
+    if (!this->readExact(this->fragments + this->fragmentsLength, length, WS_READ_TIMEOUT))
+    {
+        this->stop();
+        return false;
+    }
+    this->fragmentsLength += length;
+    return true;
+}
+
+int WebSocket::recv(uint8_t *buffer, size_t size, bool &binary)
+{
+    if (!this->isConnected())
+    {
+        return -1;
+    }
+
+    // Whatever the caller didn't read of the previous message is dropped
+    if (this->message)
+    {
+        free(this->message);
+        this->message = nullptr;
+        this->messageLength = 0;
+    }
+    else if (this->remaining > 0)
+    {
+        this->discard(this->remaining);
+    }
+    this->remaining = 0;
+
+    while (this->connected && this->client->available() >= 2)
+    {
+        uint8_t header[8];
+        if (!this->readExact(header, 2, WS_READ_TIMEOUT))
+        {
+            this->stop();
+            return -1;
+        }
+        bool final = header[0] & 0x80;
+        bool compressed = header[0] & WS_RSV1;
+        uint8_t opcode = header[0] & 0x0F;
+        if ((header[0] & 0x70 & ~(this->inflater ? WS_RSV1 : 0)) ||
+            (compressed && (opcode == WS_OPCODE_CONTINUATION || opcode >= WS_OPCODE_CLOSE)) ||
+            (opcode > WS_OPCODE_BINARY && opcode < WS_OPCODE_CLOSE) || opcode > WS_OPCODE_PONG)
+        {
+            // Reserved bits need a negotiated extension and only start a data message, reserved opcodes are never valid
+            this->fail(1002);
+            return -1;
+        }
+        if (header[1] & 0x80)
+        {
+            // Servers must not mask their frames
+            this->stop();
+            return -1;
+        }
+        uint64_t length = header[1] & 0x7F;
+        if (length == 126 || length == 127)
+        {
+            size_t extended = length == 126 ? 2 : 8;
+            if (!this->readExact(header, extended, WS_READ_TIMEOUT))
+            {
+                this->stop();
+                return -1;
+            }
+            length = 0;
+            for (size_t i = 0; i < extended; i++)
+            {
+                length = (length << 8) | header[i];
+            }
+        }
+
+        if (opcode >= WS_OPCODE_CLOSE)
+        {
+            // Control frames are at most 125 bytes, may arrive between fragments and are answered here
+            uint8_t payload[125];
+            if (length > sizeof(payload) || !this->readExact(payload, length, WS_READ_TIMEOUT))
+            {
+                this->stop();
+                return -1;
+            }
+            if (opcode == WS_OPCODE_PING)
+            {
+                this->sendFrame(WS_OPCODE_PONG, payload, length);
+            }
+            else if (opcode == WS_OPCODE_PONG && this->pingPending && length == 4)
+            {
+                // Only the pong echoing the last ping counts, unsolicited pongs are ignored
+                unsigned long stamp = ((unsigned long)payload[0] << 24) | ((unsigned long)payload[1] << 16) |
+                                      ((unsigned long)payload[2] << 8) | payload[3];
+                if (stamp == (this->pingSentAt & 0xFFFFFFFF))
+                {
+                    this->rtt = millis() - this->pingSentAt;
+                    this->rttReady = true;
+                    this->pingPending = false;
+                }
+            }
+            else if (opcode == WS_OPCODE_CLOSE)
+            {
+                this->sendFrame(WS_OPCODE_CLOSE, payload, length < 2 ? length : 2);
+                this->connected = false;
+                this->stop();
+                return -1;
+            }
+            continue;
+        }
+
+        // A continuation must follow a non-final frame, and a new message must not interrupt one
+        if ((opcode == WS_OPCODE_CONTINUATION) != (this->fragments != nullptr))
+        {
+            this->stop();
+            return -1;
+        }
 
-        // Send in chunks
-        for (int i = 0; i < totalLength; i += MAX_WS_CHUNK_SIZE)
+        if (opcode != WS_OPCODE_CONTINUATION && final && !compressed)
         {
-            String chunk = message.substring(i, min(i + MAX_WS_CHUNK_SIZE, totalLength));
-            this->ws_client->beginMessage(TYPE_TEXT);
-            this->ws_client->print(chunk);
-            this->ws_client->endMessage();
-            delay(10); // Small delay between chunks
+            // Unfragmented messages are read straight from the connection
+            binary = opcode == WS_OPCODE_BINARY;
+            this->remaining = length;
+            if (this->read(buffer, size) < 0)
+            {
+                return -1;
+            }
+            return (int)length;
         }
+
+        // Fragments and compressed messages are collected so the message is forwarded whole with its length known
+        if (opcode != WS_OPCODE_CONTINUATION)
+        {
+            this->fragmentsBinary = opcode == WS_OPCODE_BINARY;
+            this->fragmentsCompressed = compressed;
+        }
+        if (!this->appendFragment(length))
+        {
+            return -1;
+        }
+        if (!final)
+        {
+            continue;
+        }
+        binary = this->fragmentsBinary;
+        if (this->fragmentsCompressed)
+        {
+            uint8_t *inflated = nullptr;
+            int inflatedLength = this->inflater->inflate(this->fragments, this->fragmentsLength, inflated, WS_MAX_MESSAGE);
+            free(this->fragments);
+            this->fragments = nullptr;
+            if (inflatedLength < 0)
+            {
+                this->fail(inflatedLength == -2 ? 1009 : 1007);
+                return -1;
+            }
+            this->message = inflated;
+            this->messageLength = inflatedLength;
+        }
+        else
+        {
+            this->message = this->fragments;
+            this->messageLength = this->fragmentsLength;
+            this->fragments = nullptr;
+        }
+        this->remaining = this->messageLength;
+        this->fragmentsLength = 0;
+        this->read(buffer, size);
+        return (int)this->messageLength;
+    }
+    return -1;
+}
+
+int WebSocket::read(uint8_t *buffer, size_t size)
+{
+    size_t count = size < this->remaining ? size : this->remaining;
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (this->message)
+    {
+        memcpy(buffer, this->message + this->messageLength - this->remaining, count);
+    }
+    else if (!this->readExact(buffer, count, WS_READ_TIMEOUT))
+    {
+        this->stop();
+        return -1;
     }
+    this->remaining -= count;
+    return (int)count;
+}
+
+void WebSocket::forwardMessage(UART *uart, uint8_t *buffer, size_t size, size_t length, bool binary, bool announced)
+{
+    size_t copied = length < size ? length : size;
+    uart->write(buffer, copied);
+    int more;
+    while (copied < length && (more = this->read(buffer, size)) > 0)
+    {
+        uart->write(buffer, more);
+        copied += more;
+    }
+    bool cut = announced && copied < length;
+    if (cut)
+    {
+        memset(buffer, 0, size);
+        while (copied < length)
+        {
+            size_t piece = length - copied < size ? length - copied : size;
+            uart->write(buffer, piece);
+            copied += piece;
+        }
+    }
+    if (!binary)
+    {
+        uart->println();
+    }
+    if (cut)
+    {
+        uart->println(F("[ERROR] WebSocket dropped mid-message, padded to its announced length."));
+    }
+}
+
+bool WebSocket::sendFrame(uint8_t opcode, const uint8_t *data, size_t length, bool final)
+{
+    uint8_t frame[14 + WS_SEND_BUFFER];
+    size_t used = 0;
+    frame[used++] = (final ? 0x80 : 0x00) | opcode;
+    if (length < 126)
+    {
+        frame[used++] = 0x80 | length;
+    }
+    else if (length <= 0xFFFF)
+    {
+        frame[used++] = 0x80 | 126;
+        frame[used++] = length >> 8;
+        frame[used++] = length & 0xFF;
+    }
+    else
+    {
+        frame[used++] = 0x80 | 127;
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            frame[used++] = ((uint64_t)length >> shift) & 0xFF;
+        }
+    }
+    uint8_t mask[4];
+    for (int i = 0; i < 4; i++)
+    {
+        mask[i] = random(256);
+        frame[used++] = mask[i];
+    }
+
+    // Mask the payload in pieces, the first piece goes out in the same write as the header
+    size_t offset = 0;
+    do
+    {
+        size_t piece = length - offset;
+        if (piece > sizeof(frame) - used)
+        {
+            piece = sizeof(frame) - used;
+        }
+        for (size_t i = 0; i < piece; i++)
+        {
+            frame[used + i] = data[offset + i] ^ mask[(offset + i) & 3];
+        }
+        if (!this->transmit(frame, used + piece))
+        {
+            return false;
+        }
+        offset += piece;
+        used = 0;
+    } while (offset < length);
+    return true;
+}
+
+bool WebSocket::send(const uint8_t *data, size_t length, bool binary)
+{
+    if (!this->isConnected())
+    {
+        return false;
+    }
+    uint8_t opcode = binary ? WS_OPCODE_BINARY : WS_OPCODE_TEXT;
+    if (this->deflater && length >= WS_DEFLATE_MIN)
+    {
+        // Messages that don't shrink go out uncompressed
+        uint8_t *compressed = (uint8_t *)malloc(Deflater::bound(length));
+        size_t compressedLength = compressed ? this->deflater->deflate(data, length, compressed) : 0;
+        bool sent = compressedLength > 0 && this->sendFrame(opcode | WS_RSV1, compressed, compressedLength);
+        free(compressed);
+        if (compressedLength > 0)
+        {
+            return sent;
+        }
+    }
+    return this->sendFrame(opcode, data, length);
+}
+
+bool WebSocket::sendFragment(const uint8_t *data, size_t length, bool binary, bool final)
+{
+    if (!this->isConnected())
+    {
+        return false;
+    }
+    uint8_t opcode = this->sending ? WS_OPCODE_CONTINUATION : (binary ? WS_OPCODE_BINARY : WS_OPCODE_TEXT);
+    this->sending = !final;
+    return this->sendFrame(opcode, data, length, final);
+}
+
+void WebSocket::send(String &message)
+{
+    this->send((const uint8_t *)message.c_str(), message.length(), false);
 }
 
 void WebSocket::stop()
 {
-    if (this->ws_client)
+    if (this->isConnected())
+    {
+        this->sendFrame(WS_OPCODE_CLOSE, nullptr, 0);
+    }
+    if (this->client)
+    {
+        this->client->stop();
+    }
+    this->connected = false;
+    this->remaining = 0;
+    this->sending = false;
+    this->pingPending = false;
+    for (int i = 0; i < WS_QUEUE_SIZE; i++)
     {
-        this->ws_client->stop();
-        delete this->ws_client;
-        this->ws_client = nullptr;
+        this->outbound[i] = "";
     }
-}
\ No newline at end of file
+    this->queueHead = 0;
+    this->queueCount = 0;
+    this->queuedBytes = 0;
+    this->bursting = false;
+    this->burstLength = 0;
+    free(this->burst); // coalescing is set up again after every connect
+    this->burst = nullptr;
+    this->coalesceWindow = 0;
+    this->release();
+    delete this->inflater; // compression is negotiated again on every connect
+    this->inflater = nullptr;
+    delete this->deflater;
+    this->deflater = nullptr;
+}
@@ -1,7 +1,17 @@
 #pragma once
 #include <Arduino.h>
-#include <ArduinoHttpClient.h>
 #include "wifi_utils.hpp"
+#include "uart.hpp"
+#include "deflate.hpp"
+
+#define WS_HANDSHAKE_SIZE 1024     // Largest upgrade request
+#define WS_HANDSHAKE_TIMEOUT 10000 // Time (ms) to wait for the upgrade response
+#define WS_READ_TIMEOUT 5000       // Time (ms) to wait for the rest of a frame once it started arriving
+#define WS_SEND_BUFFER 256         // Payload bytes masked and written at once
+#define WS_MAX_MESSAGE 8192        // Largest fragmented message reassembled, bigger ones close the connection
+#define WS_QUEUE_SIZE 8            // Outbound text messages waiting to be sent
+#define WS_COALESCE_SIZE 1436      // Frame bytes written at once when coalescing, about one TCP segment
+#define WS_DEFLATE_MIN 32          // Shortest message worth compressing
 
 class WebSocket
 {
@@ -15,15 +25,83 @@ public:
         const char *path,                     // The path to connect to on the server (e.g. "/ws")
         const char *headerKeys[] = nullptr,   // Array of header keys
         const char *headerValues[] = nullptr, // Array of header values
-        int headerSize = 0                    // Number of headers
+        int headerSize = 0,                   // Number of headers
+        bool secure = false                   // Whether to use TLS (wss://)
     );
     bool isConnected();
-    void ping();
-    String recv();
-    void send(String &message);
+    bool available();                                                               // Whether an inbound frame started arriving
+    void ping();                                                                    // Sends a ping carrying the time it was sent, its pong updates the round trip time
+    int recv(uint8_t *buffer, size_t size, bool &binary);                           // Starts the next message: copies up to size bytes of it and returns its length, or -1 if none arrived
+    int read(uint8_t *buffer, size_t size);                                         // Copies more of the message started by recv(), returns the bytes copied
+    // Writes the message started by recv() over UART, its first bytes already in buffer, and ends text with a newline.
+    // When the length was announced, a message the connection drops partway through is padded with zeros to it
+    // to keep the framing, then an [ERROR] line follows
+    void forwardMessage(UART *uart, uint8_t *buffer, size_t size, size_t length, bool binary, bool announced);
+    bool send(const uint8_t *data, size_t length, bool binary);                     // Sends one text or binary message
+    bool sendFragment(const uint8_t *data, size_t length, bool binary, bool final); // Sends part of a message, the last part has final set
+    void send(String &message);                                                     // Sends one text message
     void stop();
 
+    void setKeepAlive(uint32_t interval, uint32_t timeout);      // Pings every interval ms and gives up when a pong takes longer than timeout ms, 0 disables
+    bool queue(const String &message);                           // Queues one text message, returns false when the queue is full
+    bool queueFull() const;                                      // Whether queue() would fail
+    void flush();                                                // Sends every queued message
+    bool service();                                              // Sends queued messages that are due and any ping due, returns false once the peer is considered dead (pong late and no frame waiting)
+    bool takeRtt(uint32_t &rtt);                                 // Returns true once per answered ping, with its round trip time in ms
+    void setDeflate(uint8_t windowBits, bool noContextTakeover); // Offers permessage-deflate with a 2^windowBits window on the next connect, 0 disables
+    bool compressing() const;                                    // Whether the server accepted permessage-deflate
+    void setCoalesce(uint32_t window, size_t threshold);         // Holds queued text up to window ms (0 disables) or until threshold bytes wait, then writes the frames together. Call after connect()
+
 private:
-    WebSocketClient *ws_client;
-    WiFiClient wifi_client;
-};
\ No newline at end of file
+    bool open(const char *serverName, uint16_t port, bool secure);                         // Opens the TCP or TLS connection
+    bool readExact(uint8_t *buffer, size_t size, uint32_t timeout);                        // Waits for size bytes, returns false on timeout or close
+    bool sendFrame(uint8_t opcode, const uint8_t *data, size_t length, bool final = true); // Writes one masked frame
+    bool transmit(const uint8_t *data, size_t length);                                     // Writes frame bytes, or collects them while a burst is built
+    bool flushBurst();                                                                     // Writes the collected frame bytes
+    void sendQueued();                                                                     // Sends the oldest queued message
+    bool negotiate(const char *parameters);                                                // Sets up compression from the accepted extension, false if it can't be
+    void fail(uint16_t code);                                                              // Closes the connection with a status code
+    bool appendFragment(uint64_t length);                                                  // Reads a fragment's payload into the reassembly buffer
+    void discard(size_t size);                                                             // Skips payload bytes
+    void release();                                                                        // Frees the reassembly buffers
+
+#ifndef BOARD_BW16
+    WiFiClientSecure *secureClient; // Kept across reconnects for wss://, created on first use
+#else
+    WiFiSSLClient *secureClient; // Kept across reconnects for wss://, created on first use
+#endif
+    WiFiClient *plainClient;  // Kept across reconnects for ws://, created on first use
+    Client *client;           // Connection the frames travel on, nullptr before the first connect
+    bool connected;           // Whether the upgrade succeeded and no close frame was exchanged
+    size_t remaining;         // Payload bytes of the current message not read yet
+    bool sending;             // Whether an outbound message was started but not finished
+    uint8_t *fragments;       // Inbound fragments received so far, nullptr when none
+    size_t fragmentsLength;   // Bytes in fragments
+    bool fragmentsBinary;     // Whether the fragmented message is binary
+    bool fragmentsCompressed; // Whether the fragmented message is compressed
+    uint8_t *message;         // Reassembled message being read, nullptr when reading from the connection
+    size_t messageLength;     // Bytes in message
+
+    uint32_t pingInterval;          // Time (ms) between keepalive pings, 0 when disabled
+    uint32_t pongTimeout;           // Time (ms) a pong may take before the peer is considered dead
+    unsigned long pingSentAt;       // millis() of the last ping
+    bool pingPending;               // Whether the last ping was not answered yet
+    uint32_t rtt;                   // Round trip time (ms) of the last answered ping
+    bool rttReady;                  // Whether rtt was not handed out by takeRtt() yet
+    String outbound[WS_QUEUE_SIZE]; // Queued text messages
+    uint8_t queueHead;              // Index of the oldest queued message
+    uint8_t queueCount;             // Number of queued messages
+
+    uint8_t deflateBits;           // Window bits offered for permessage-deflate, 0 when not offered
+    bool deflateNoContextTakeover; // Whether to offer resetting the compression context after each message
+    Inflater *inflater;            // Decompresses inbound messages, nullptr when not negotiated
+    Deflater *deflater;            // Compresses outbound messages, nullptr when not negotiated
+
+    uint32_t coalesceWindow;         // Longest time (ms) a queued message waits for others, 0 when not coalescing
+    size_t coalesceThreshold;        // Queued bytes that are sent without waiting for the window
+    unsigned long queuedAt;          // millis() when the oldest queued message was queued
+    size_t queuedBytes;              // Bytes of the queued messages
+    bool bursting;                   // Whether frames are collected in burst instead of written
+    uint8_t *burst;                  // Frames of one burst, WS_COALESCE_SIZE bytes allocated by setCoalesce() while coalescing
+    size_t burstLength;              // Bytes in burst
+};
@@ -0,0 +1,579 @@
+/* Host tests for the HTTP/1.1 client core (src/flipper-http/http_core.hpp/cpp)
+Build and run with tools/test_http_core.sh. The parser and request writer are
+checked directly, HttpConnection is checked against a local server on 127.0.0.1.
+*/
+#include "../../src/flipper-http/http_core.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <errno.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if (!(condition))                                                   \
+        {                                                                   \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition);     \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+// Feeds a whole response to the parser step bytes at a time and collects the body
+static std::string parse(HttpResponseParser &parser, const std::string &response, size_t step)
+{
+    std::string body;
+    size_t position = 0;
+    while (position < response.size() && !parser.done() && !parser.failed())
+    {
+        size_t size = response.size() - position < step ? response.size() - position : step;
+        size_t bodyOffset, bodyLength;
+        size_t used = parser.feed((const uint8_t *)response.data() + position, size, bodyOffset, bodyLength);
+        body.append(response, position + bodyOffset, bodyLength);
+        position += used;
+    }
+    return body;
+}
+
+static void testParser()
+{
+    const size_t steps[] = {1, 2, 7, 4096};
+    for (size_t step : steps)
+    {
+        HttpResponseParser parser;
+        std::string body = parse(parser, "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello", step);
+        CHECK(parser.done());
+        CHECK(parser.status() == 200);
+        CHECK(parser.contentLength() == 5);
+        CHECK(parser.keepAlive());
+        CHECK(body == "hello");
+
+        parser.reset();
+        body = parse(parser, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5;ext=1\r\nhello\r\nB\r\n, chunked!!\r\n0\r\nX-Trailer: 1\r\n\r\n", step);
+        CHECK(parser.done());
+        CHECK(parser.chunked());
+        CHECK(body == "hello, chunked!!");
+
+        parser.reset();
+        body = parse(parser, "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 201 Created\r\nContent-Length: 2\r\n\r\nok", step);
+        CHECK(parser.done());
+        CHECK(parser.status() == 201);
+        CHECK(body == "ok");
+    }
+
+    // A body without a length ends when the connection closes
+    HttpResponseParser parser;
+    std::string body = parse(parser, "HTTP/1.0 200 OK\r\n\r\nuntil close", 3);
+    CHECK(!parser.done());
+    CHECK(!parser.keepAlive());
+    CHECK(body == "until close");
+    parser.finish();
+    CHECK(parser.done());
+
+    // Closing in the middle of a sized body is an error
+    parser.reset();
+    parse(parser, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", 64);
+    parser.finish();
+    CHECK(parser.failed());
+
+    // HEAD, 204 and 304 responses have no body whatever the headers say
+    parser.reset(true);
+    parse(parser, "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n", 64);
+    CHECK(parser.done());
+    parser.reset();
+    parse(parser, "HTTP/1.1 204 No Content\r\n\r\n", 64);
+    CHECK(parser.done());
+
+    parser.reset();
+    parse(parser, "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n", 64);
+    CHECK(parser.done());
+    CHECK(!parser.keepAlive());
+
+    parser.reset();
+    parse(parser, "SSH-2.0-OpenSSH\r\n", 64);
+    CHECK(parser.failed());
+
+    parser.reset();
+    parse(parser, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", 64);
+    CHECK(parser.failed());
+}
+
+// Header callback context: remembers one header's value
+struct HeaderCapture
+{
+    const char *name;
+    std::string value;
+};
+
+static void captureHeader(void *context, const char *name, const char *value)
+{
+    HeaderCapture *capture = (HeaderCapture *)context;
+    if (strcasecmp(name, capture->name) == 0)
+    {
+        capture->value = value;
+    }
+}
+
+static void testHeaderCallback()
+{
+    HeaderCapture capture = {"Content-Range", ""};
+    HttpResponseParser parser;
+    parser.onHeader(captureHeader, &capture);
+    parse(parser, "HTTP/1.1 206 Partial Content\r\ncontent-range :  bytes 0-1/10  \r\nContent-Length: 2\r\n\r\nab", 5);
+    CHECK(parser.status() == 206);
+    CHECK(capture.value == "bytes 0-1/10");
+}
+
+static void testRequestHead()
+{
+    char head[256];
+    const char *keys[] = {"Range", "X-Token"};
+    const char *values[] = {"bytes=5-", "abc"};
+    size_t length = httpWriteRequestHead(head, sizeof(head), "GET", "example.com", 443, "/file", keys, values, 2, -2, true);
+    CHECK(length == strlen(head));
+    CHECK(std::string(head) == "GET /file HTTP/1.1\r\nHost: example.com\r\nRange: bytes=5-\r\nX-Token: abc\r\n\r\n");
+
+    length = httpWriteRequestHead(head, sizeof(head), "POST", "example.com", 80, "", nullptr, nullptr, 0, 2, false);
+    CHECK(std::string(head) == "POST / HTTP/1.1\r\nHost: example.com\r\nContent-Length: 2\r\nConnection: close\r\n\r\n");
+
+    length = httpWriteRequestHead(head, sizeof(head), "POST", "example.com", 443, "/up", nullptr, nullptr, 0, -1, true);
+    CHECK(std::string(head) == "POST /up HTTP/1.1\r\nHost: example.com\r\nTransfer-Encoding: chunked\r\n\r\n");
+
+    CHECK(httpWriteRequestHead(head, 20, "GET", "example.com", 443, "/", nullptr, nullptr, 0, -2, true) == 0);
+
+    // Other ports are named in the Host header
+    length = httpWriteRequestHead(head, sizeof(head), "GET", "example.com", 8080, "/", nullptr, nullptr, 0, -2, true);
+    CHECK(std::string(head) == "GET / HTTP/1.1\r\nHost: example.com:8080\r\n\r\n");
+
+    // The allocated head has no size limit
+    std::string token(3000, 't');
+    const char *longKeys[] = {"Authorization"};
+    const char *longValues[] = {token.c_str()};
+    char *allocated = httpNewRequestHead(length, "GET", "example.com", 443, "/", longKeys, longValues, 1, -2, true);
+    CHECK(allocated && length == strlen(allocated));
+    CHECK(allocated && std::string(allocated) == "GET / HTTP/1.1\r\nHost: example.com\r\nAuthorization: " + token + "\r\n\r\n");
+    free(allocated);
+
+    char chunk[16];
+    CHECK(httpWriteChunkHeader(chunk, sizeof(chunk), 255) == 4);
+    CHECK(std::string(chunk) == "ff\r\n");
+}
+
+static void testSplitUrl()
+{
+    char host[32];
+    uint16_t port;
+    const char *path;
+    bool secure;
+    CHECK(httpSplitUrl("https://example.com/a/b?c=d", host, sizeof(host), &port, &path, &secure));
+    CHECK(std::string(host) == "example.com" && port == 443 && secure && std::string(path) == "/a/b?c=d");
+    CHECK(httpSplitUrl("http://localhost:8080", host, sizeof(host), &port, &path, &secure));
+    CHECK(std::string(host) == "localhost" && port == 8080 && !secure && std::string(path) == "/");
+    CHECK(httpSplitUrl("ws://10.0.0.2/socket", host, sizeof(host), &port, &path, &secure));
+    CHECK(port == 80 && !secure);
+    CHECK(httpSplitUrl("example.com/x", host, sizeof(host), &port, &path, &secure));
+    CHECK(port == 443 && secure);
+    CHECK(!httpSplitUrl("https:///path", host, sizeof(host), &port, &path, &secure));
+    CHECK(!httpSplitUrl("https://a-host-name-that-is-much-longer-than-the-buffer.example.com/", host, sizeof(host), &port, &path, &secure));
+}
+
+// What the local server does for the next request
+struct Reply
+{
+    std::string response; // Bytes written back
+    bool close;           // Close the connection afterwards
+    int delay;            // Milliseconds to wait before answering
+};
+
+// Single-threaded HTTP server on 127.0.0.1 that answers requests from a script
+class LocalServer
+{
+public:
+    LocalServer() : accepts(0), received(0), requests(0)
+    {
+        this->listener = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(this->listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(this->listener, (sockaddr *)&address, sizeof(address));
+        socklen_t size = sizeof(address);
+        getsockname(this->listener, (sockaddr *)&address, &size);
+        this->port = ntohs(address.sin_port);
+        listen(this->listener, 4);
+        std::thread(&LocalServer::run, this).detach();
+    }
+
+    void queue(const std::string &response, bool close = false, int delay = 0)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->replies.push_back({response, close, delay});
+    }
+
+    // Head and decoded body of the last request received
+    std::string lastRequest()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->last;
+    }
+
+    uint16_t port;
+    std::atomic<int> accepts;  // Connections accepted so far
+    std::atomic<int> received; // Requests received so far
+    std::atomic<int> requests; // Requests answered so far
+
+private:
+    // Reads bytes up to and including the next CRLF
+    static bool readLine(int fd, std::string &line)
+    {
+        char c;
+        while (line.size() < 2 || line.compare(line.size() - 2, 2, "\r\n") != 0)
+        {
+            if (recv(fd, &c, 1, 0) != 1)
+            {
+                return false;
+            }
+            line += c;
+        }
+        return true;
+    }
+
+    // Reads one request head and its Content-Length or chunked body, returns false when the client closed
+    bool readRequest(int fd)
+    {
+        std::string request, line;
+        do
+        {
+            line.clear();
+            if (!readLine(fd, line))
+            {
+                return false;
+            }
+            request += line;
+        } while (line != "\r\n");
+        std::string body;
+        if (request.find("Transfer-Encoding: chunked") != std::string::npos)
+        {
+            long length;
+            do
+            {
+                line.clear();
+                if (!readLine(fd, line))
+                {
+                    return false;
+                }
+                length = strtol(line.c_str(), nullptr, 16);
+                std::string chunk(length + 2, '\0');
+                for (size_t got = 0; got < chunk.size();)
+                {
+                    ssize_t count = recv(fd, &chunk[got], chunk.size() - got, 0);
+                    if (count <= 0)
+                    {
+                        return false;
+                    }
+                    got += count;
+                }
+                body += chunk.substr(0, length);
+            } while (length > 0);
+        }
+        else
+        {
+            size_t header = request.find("Content-Length: ");
+            long length = header == std::string::npos ? 0 : strtol(request.c_str() + header + 16, nullptr, 10);
+            char c;
+            while (length-- > 0)
+            {
+                if (recv(fd, &c, 1, 0) != 1)
+                {
+                    return false;
+                }
+                body += c;
+            }
+        }
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->last = request + body;
+        this->received++;
+        return true;
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            int fd = accept(this->listener, nullptr, nullptr);
+            if (fd < 0)
+            {
+                return;
+            }
+            this->accepts++;
+            while (readRequest(fd))
+            {
+                Reply reply;
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    if (this->replies.empty())
+                    {
+                        break;
+                    }
+                    reply = this->replies.front();
+                    this->replies.pop_front();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(reply.delay));
+                // Written in two parts so the client sees split reads
+                size_t half = reply.response.size() / 2;
+                send(fd, reply.response.data(), half, MSG_NOSIGNAL);
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                send(fd, reply.response.data() + half, reply.response.size() - half, MSG_NOSIGNAL);
+                this->requests++;
+                if (reply.close)
+                {
+                    break;
+                }
+            }
+            close(fd);
+        }
+    }
+
+    int listener;
+    std::mutex mutex;
+    std::deque<Reply> replies;
+    std::string last;
+};
+
+// HttpStream over a POSIX socket. Like the boards' clients it only notices
+// that the server closed the connection once it tries to read from it
+class SocketStream : public HttpStream
+{
+public:
+    SocketStream() : clockOffset(0), fd(-1), peerClosed(false) {}
+    ~SocketStream() override { this->stop(); }
+
+    bool connect(const char *host, uint16_t port) override
+    {
+        this->stop();
+        this->fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (inet_pton(AF_INET, strcmp(host, "localhost") == 0 ? "127.0.0.1" : host, &address.sin_addr) != 1 ||
+            ::connect(this->fd, (sockaddr *)&address, sizeof(address)) != 0)
+        {
+            this->stop();
+            return false;
+        }
+        this->peerClosed = false;
+        this->connects++;
+        return true;
+    }
+    bool connected() override { return this->fd >= 0 && !this->peerClosed; }
+    int available() override
+    {
+        if (this->fd < 0)
+        {
+            return 0;
+        }
+        char c;
+        ssize_t peeked = recv(this->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (peeked == 0 || (peeked < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            this->peerClosed = true;
+            return 0;
+        }
+        int count = 0;
+        ioctl(this->fd, FIONREAD, &count);
+        return count;
+    }
+    int read(uint8_t *buffer, size_t size) override { return (int)recv(this->fd, buffer, size, 0); }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        ssize_t written = this->fd < 0 ? -1 : send(this->fd, buffer, size, MSG_NOSIGNAL);
+        return written > 0 ? (size_t)written : 0;
+    }
+    void stop() override
+    {
+        if (this->fd >= 0)
+        {
+            close(this->fd);
+        }
+        this->fd = -1;
+    }
+    uint32_t millis() override
+    {
+        using namespace std::chrono;
+        return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count() + this->clockOffset;
+    }
+    void idle() override { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+
+    int connects = 0;     // Connections opened so far
+    uint32_t clockOffset; // Added to millis() to skip ahead in time
+
+private:
+    int fd;
+    bool peerClosed;
+};
+
+// Sends a GET over connection and returns the body, or "<error>" if it failed
+static std::string get(HttpConnection &connection, uint16_t port, int *status = nullptr, uint32_t timeout = 2000)
+{
+    char head[256];
+    size_t headLength = httpWriteRequestHead(head, sizeof(head), "GET", "127.0.0.1", port, "/", nullptr, nullptr, 0, -2, true);
+    HttpResponseParser parser;
+    int code = connection.request("127.0.0.1", port, (const uint8_t *)head, headLength, nullptr, 0, parser, timeout);
+    if (status)
+    {
+        *status = code;
+    }
+    if (code < 0)
+    {
+        return "<error>";
+    }
+    std::string body;
+    const uint8_t *data;
+    int length;
+    while ((length = connection.readBody(parser, data, 2000)) > 0)
+    {
+        body.append((const char *)data, length);
+    }
+    if (length < 0)
+    {
+        body = "<error>";
+    }
+    connection.end(parser);
+    return body;
+}
+
+static void testConnection()
+{
+    LocalServer server;
+    SocketStream stream;
+    HttpConnection connection(&stream);
+
+    // Keep-alive: two responses, one sized and one chunked, over one connection
+    server.queue("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nfirst");
+    server.queue("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nsec\r\n3\r\nond\r\n0\r\n\r\n");
+    CHECK(get(connection, server.port) == "first");
+    CHECK(get(connection, server.port) == "second");
+    CHECK(stream.connects == 1);
+    CHECK(server.accepts == 1);
+
+    // The server closes the kept-alive connection without saying so: the next request is retried on a new one
+    server.queue("HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nlast", true);
+    server.queue("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nagain");
+    CHECK(get(connection, server.port) == "last");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(get(connection, server.port) == "again");
+    CHECK(stream.connects == 2);
+    CHECK(server.requests == 4);
+
+    // A connection idle for longer than HTTP_CORE_IDLE_TIMEOUT is replaced before it is used
+    server.queue("HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nidle");
+    stream.clockOffset += HTTP_CORE_IDLE_TIMEOUT + 1;
+    CHECK(get(connection, server.port) == "idle");
+    CHECK(stream.connects == 3);
+
+    // Connection: close is honoured
+    server.queue("HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 3\r\n\r\nbye", true);
+    server.queue("HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nnew");
+    CHECK(get(connection, server.port) == "bye");
+    CHECK(get(connection, server.port) == "new");
+    CHECK(stream.connects == 4);
+
+    // A response cut off in the headers is not retried on a new connection, since the server did answer
+    server.queue("HTTP/1.1 200 OK\r\nContent-Le", true);
+    int status = 0;
+    CHECK(get(connection, server.port, &status) == "<error>");
+    CHECK(status == -1);
+    CHECK(stream.connects == 4);
+
+    // A body cut off before its Content-Length is an error, not a short success
+    server.queue("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", true);
+    CHECK(get(connection, server.port) == "<error>");
+
+    // A slow server on a reused connection times out once, without getting the request a second time
+    server.queue("HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nwarm");
+    CHECK(get(connection, server.port) == "warm");
+    int connects = stream.connects;
+    int received = server.received;
+    server.queue("HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nslow", false, 300);
+    CHECK(get(connection, server.port, &status, 100) == "<error>");
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    CHECK(server.received == received + 1);
+    CHECK(stream.connects == connects);
+
+    // Nothing listening: the request fails without hanging
+    HttpResponseParser parser;
+    CHECK(connection.request("127.0.0.1", 1, (const uint8_t *)"x", 1, nullptr, 0, parser, 500) == -1);
+}
+
+static void testChunkedUpload()
+{
+    // An upload to a URL with an explicit port, sent the way HTTP::streamUpload frames it
+    LocalServer server;
+    SocketStream stream;
+    HttpConnection connection(&stream);
+    server.queue("HTTP/1.1 201 Created\r\nContent-Length: 2\r\n\r\nok", true);
+
+    std::string url = "http://127.0.0.1:" + std::to_string(server.port) + "/upload?name=a";
+    char host[HTTP_CORE_HOST_SIZE];
+    uint16_t port;
+    const char *path;
+    bool secure;
+    CHECK(httpSplitUrl(url.c_str(), host, sizeof(host), &port, &path, &secure));
+    CHECK(std::string(host) == "127.0.0.1" && port == server.port && !secure);
+
+    const char *keys[] = {"Content-Type"};
+    const char *values[] = {"text/plain"};
+    size_t headLength;
+    char *head = httpNewRequestHead(headLength, "POST", host, port, path, keys, values, 1, -1, false);
+    CHECK(head != nullptr);
+    CHECK(connection.open(host, port));
+    CHECK(connection.send((const uint8_t *)head, headLength));
+    free(head);
+    const char *parts[] = {"hello ", "chunked world"};
+    char chunk[16];
+    for (const char *part : parts)
+    {
+        CHECK(connection.send((const uint8_t *)chunk, httpWriteChunkHeader(chunk, sizeof(chunk), strlen(part))));
+        CHECK(connection.send(part) && connection.send("\r\n"));
+    }
+    CHECK(connection.send("0\r\n\r\n"));
+
+    HttpResponseParser parser;
+    CHECK(connection.readHeaders(parser, 2000) == 201);
+    std::string request = server.lastRequest();
+    CHECK(request.find("POST /upload?name=a HTTP/1.1\r\n") == 0);
+    CHECK(request.find("\r\nHost: 127.0.0.1:" + std::to_string(server.port) + "\r\n") != std::string::npos);
+    CHECK(request.find("\r\nConnection: close\r\n") != std::string::npos);
+    CHECK(request.size() > 19 && request.compare(request.size() - 19, 19, "hello chunked world") == 0);
+    connection.close();
+}
+
+int main()
+{
+    testParser();
+    testHeaderCallback();
+    testRequestHead();
+    testSplitUrl();
+    testConnection();
+    testChunkedUpload();
+    if (failures > 0)
+    {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All HTTP core tests passed\n");
+    return 0;
+}
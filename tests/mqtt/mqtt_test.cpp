@@ -0,0 +1,294 @@
+/* Host tests for the MQTT client (src/flipper-http/mqtt.hpp/cpp)
+Build and run with tools/test_mqtt.sh. The headers in stub/ stand in for the
+Arduino core, ArduinoJson, the UART and the WiFi clients, and a scripted broker
+on 127.0.0.1 plays the other side of each session.
+*/
+#include "mqtt.hpp"
+#include <functional>
+#include <sys/time.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if (!(condition))                                                   \
+        {                                                                   \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition);     \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+struct Packet
+{
+    uint8_t first;    // Type and flags
+    std::string body; // Everything after the remaining length
+};
+
+// Broker side of one connection, run on its own thread by a test script
+class Broker
+{
+public:
+    Broker()
+    {
+        this->listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(this->listener, (sockaddr *)&address, sizeof(address));
+        listen(this->listener, 1);
+        socklen_t length = sizeof(address);
+        getsockname(this->listener, (sockaddr *)&address, &length);
+        this->port = ntohs(address.sin_port);
+    }
+    ~Broker()
+    {
+        if (this->thread.joinable())
+        {
+            this->thread.join();
+        }
+        if (this->fd >= 0)
+        {
+            close(this->fd);
+        }
+        close(this->listener);
+    }
+
+    // Accepts the client and runs the script against it
+    void run(std::function<void(Broker &)> script)
+    {
+        this->thread = std::thread([this, script]()
+                                   {
+            this->fd = accept(this->listener, nullptr, nullptr);
+            timeval timeout = {2, 0};
+            setsockopt(this->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            script(*this); });
+    }
+    void join() { this->thread.join(); }
+
+    // Reads one packet, false on timeout or close
+    bool receive(Packet &packet)
+    {
+        uint8_t byte;
+        if (!this->readExact(&packet.first, 1))
+        {
+            return false;
+        }
+        size_t remaining = 0, multiplier = 1;
+        do
+        {
+            if (!this->readExact(&byte, 1))
+            {
+                return false;
+            }
+            remaining += (byte & 0x7F) * multiplier;
+            multiplier *= 128;
+        } while (byte & 0x80);
+        packet.body.resize(remaining);
+        return remaining == 0 || this->readExact((uint8_t *)&packet.body[0], remaining);
+    }
+
+    // Writes one packet with its fixed header
+    void send(uint8_t first, const std::string &body)
+    {
+        std::string packet(1, (char)first);
+        size_t remaining = body.size();
+        do
+        {
+            uint8_t digit = remaining % 128;
+            remaining /= 128;
+            packet += (char)(digit | (remaining > 0 ? 0x80 : 0));
+        } while (remaining > 0);
+        packet += body;
+        ::send(this->fd, packet.data(), packet.size(), MSG_NOSIGNAL);
+    }
+
+    // PUBLISH with a packet id when qos is 1
+    void publish(const std::string &topic, const std::string &payload, uint8_t qos, uint16_t id)
+    {
+        std::string body = field(topic);
+        if (qos > 0)
+        {
+            body += (char)(id >> 8);
+            body += (char)(id & 0xFF);
+        }
+        this->send(0x30 | (qos << 1), body + payload);
+    }
+
+    static std::string field(const std::string &text)
+    {
+        return std::string(1, (char)(text.size() >> 8)) + (char)(text.size() & 0xFF) + text;
+    }
+    static uint16_t id(const std::string &body, size_t offset = 0)
+    {
+        return ((uint8_t)body[offset] << 8) | (uint8_t)body[offset + 1];
+    }
+
+    uint16_t port;
+
+private:
+    bool readExact(uint8_t *buffer, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t received = recv(this->fd, buffer, size, 0);
+            if (received <= 0)
+            {
+                return false;
+            }
+            buffer += received;
+            size -= received;
+        }
+        return true;
+    }
+
+    int listener;
+    int fd = -1;
+    std::thread thread;
+};
+
+// Accepts CONNECT with a CONNACK
+static bool handshake(Broker &broker)
+{
+    Packet packet;
+    if (!broker.receive(packet) || packet.first >> 4 != 1)
+    {
+        return false;
+    }
+    broker.send(0x20, std::string("\x00\x00", 2));
+    return true;
+}
+
+// Runs the client loop until the UART holds count lines or a second passes
+static void loopUntil(MqttClient &client, UART &uart, size_t count)
+{
+    unsigned long start = millis();
+    while (uart.lines.size() < count && millis() - start < 1000)
+    {
+        client.loop();
+        delay(2);
+    }
+}
+
+static void testSession()
+{
+    Broker broker;
+    bool connected = false, acked = false, published = false, disconnected = false;
+    broker.run([&](Broker &b)
+               {
+        connected = handshake(b);
+        Packet packet;
+        if (b.receive(packet) && packet.first >> 4 == 8)
+        {
+            b.send(0x90, packet.body.substr(0, 2) + '\x01');
+            b.publish("a/b", "hi \"there\"", 1, 7);
+        }
+        // The client acknowledges the broker's publish and sends its own
+        while (b.receive(packet) && packet.first >> 4 != 14)
+        {
+            if (packet.first >> 4 == 4)
+            {
+                acked = Broker::id(packet.body) == 7;
+            }
+            else if (packet.first >> 4 == 3)
+            {
+                size_t topic = Broker::id(packet.body);
+                published = packet.body.substr(2, topic) == "c/d" && packet.body.substr(4 + topic) == "xyz";
+                b.send(0x40, packet.body.substr(2 + topic, 2));
+            }
+        }
+        disconnected = packet.first >> 4 == 14; });
+
+    UART uart;
+    MqttClient client(&uart);
+    char url[32];
+    snprintf(url, sizeof(url), "mqtt://127.0.0.1:%u", broker.port);
+    CHECK(client.connect(url, "flipper"));
+    CHECK(client.subscribe("a/b", 1) == 1);
+    int id = client.publish("c/d", (const uint8_t *)"xyz", 3, 1, false);
+    CHECK(id > 0);
+    loopUntil(client, uart, 2);
+    client.disconnect();
+    broker.join();
+
+    CHECK(connected && acked && published && disconnected);
+    CHECK(uart.lines.size() == 2);
+    CHECK(uart.lines.size() > 0 && uart.lines[0] == "[MQTT/MESSAGE]{\"topic\":\"a/b\",\"payload\":\"hi \\\"there\\\"\",\"qos\":1,\"retain\":false}");
+    CHECK(uart.lines.size() > 1 && uart.lines[1] == "[MQTT/PUBACK]{\"id\":" + std::to_string(id) + "}");
+}
+
+static void testTruncatedPublish()
+{
+    // A QoS 1 publish too long to keep whole is forwarded truncated and left unacknowledged,
+    // and the publish after it is still parsed and acknowledged
+    Broker broker;
+    std::vector<uint16_t> acks;
+    broker.run([&](Broker &b)
+               {
+        if (!handshake(b))
+        {
+            return;
+        }
+        b.publish("big", std::string(MQTT_PACKET_SIZE + 500, 'x'), 1, 9);
+        b.publish("small", "ok", 1, 10);
+        Packet packet;
+        while (b.receive(packet) && packet.first >> 4 != 14)
+        {
+            if (packet.first >> 4 == 4)
+            {
+                acks.push_back(Broker::id(packet.body));
+            }
+        } });
+
+    UART uart;
+    MqttClient client(&uart);
+    char url[32];
+    snprintf(url, sizeof(url), "mqtt://127.0.0.1:%u", broker.port);
+    CHECK(client.connect(url, "flipper"));
+    loopUntil(client, uart, 2);
+    delay(50);
+    client.loop();
+    client.disconnect();
+    broker.join();
+
+    CHECK(uart.lines.size() == 2);
+    CHECK(uart.lines.size() > 0 && uart.lines[0].find("\"topic\":\"big\"") != std::string::npos);
+    CHECK(uart.lines.size() > 0 && uart.lines[0].find("\"truncated\":true") != std::string::npos);
+    CHECK(uart.lines.size() > 1 && uart.lines[1] == "[MQTT/MESSAGE]{\"topic\":\"small\",\"payload\":\"ok\",\"qos\":1,\"retain\":false}");
+    CHECK(acks.size() == 1 && acks[0] == 10);
+}
+
+static void testRefused()
+{
+    // A CONNACK with a non-zero return code fails connect()
+    Broker broker;
+    broker.run([](Broker &b)
+               {
+        Packet packet;
+        if (b.receive(packet))
+        {
+            b.send(0x20, std::string("\x00\x05", 2));
+        } });
+
+    UART uart;
+    MqttClient client(&uart);
+    char url[32];
+    snprintf(url, sizeof(url), "mqtt://127.0.0.1:%u", broker.port);
+    CHECK(!client.connect(url, "flipper", "user", "wrong"));
+    CHECK(!client.connected());
+    broker.join();
+}
+
+int main()
+{
+    testSession();
+    testTruncatedPublish();
+    testRefused();
+    if (failures > 0)
+    {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All MQTT tests passed\n");
+    return 0;
+}
@@ -0,0 +1,34 @@
+// Desktop stand-in for the Arduino core, just enough for mqtt.cpp
+#pragma once
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+class String : public std::string
+{
+public:
+    String() {}
+    String(const char *text) : std::string(text) {}
+    String(const std::string &text) : std::string(text) {}
+    String(int value) : std::string(std::to_string(value)) {}
+    String(unsigned int value) : std::string(std::to_string(value)) {}
+    void remove(size_t index) { this->erase(index); }
+};
+
+inline String operator+(const char *left, const String &right) { return String(std::string(left) + (const std::string &)right); }
+inline String operator+(const String &left, const char *right) { return String((const std::string &)left + right); }
+inline String operator+(const String &left, const String &right) { return String((const std::string &)left + (const std::string &)right); }
+
+inline unsigned long millis()
+{
+    using namespace std::chrono;
+    return (unsigned long)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+#define F(text) text
@@ -0,0 +1,68 @@
+// Desktop stand-in for ArduinoJson: a flat object that keeps its keys in insertion order
+#pragma once
+#include <Arduino.h>
+#include <utility>
+#include <vector>
+
+class JsonVariant
+{
+public:
+    JsonVariant &operator=(const char *value)
+    {
+        this->text = "\"";
+        for (const char *c = value; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                this->text += '\\';
+            }
+            this->text += *c;
+        }
+        this->text += "\"";
+        return *this;
+    }
+    JsonVariant &operator=(bool value)
+    {
+        this->text = value ? "true" : "false";
+        return *this;
+    }
+    JsonVariant &operator=(int value)
+    {
+        this->text = std::to_string(value);
+        return *this;
+    }
+    JsonVariant &operator=(uint8_t value) { return *this = (int)value; }
+    std::string text;
+};
+
+class JsonDocument
+{
+public:
+    JsonVariant &operator[](const char *key)
+    {
+        for (auto &member : this->members)
+        {
+            if (member.first == key)
+            {
+                return member.second;
+            }
+        }
+        this->members.push_back(std::make_pair(std::string(key), JsonVariant()));
+        return this->members.back().second;
+    }
+    std::vector<std::pair<std::string, JsonVariant>> members;
+};
+
+inline void serializeJson(const JsonDocument &doc, String &output)
+{
+    output = "{";
+    for (const auto &member : doc.members)
+    {
+        if (output.size() > 1)
+        {
+            output += ",";
+        }
+        output += "\"" + member.first + "\":" + member.second.text;
+    }
+    output += "}";
+}
@@ -0,0 +1,2 @@
+#pragma once
+static const char root_ca[] = "";
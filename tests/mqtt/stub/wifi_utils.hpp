@@ -0,0 +1,91 @@
+// Desktop stand-in for the WiFi clients: plain non-blocking TCP sockets
+#pragma once
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class Client
+{
+public:
+    virtual ~Client() {}
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    virtual int available() = 0;
+    virtual int read(uint8_t *buffer, size_t size) = 0;
+    virtual void stop() = 0;
+    virtual uint8_t connected() = 0;
+};
+
+class WiFiClient : public Client
+{
+public:
+    ~WiFiClient() { this->stop(); }
+    int connect(const char *host, uint16_t port)
+    {
+        this->stop();
+        this->fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (this->fd < 0 || inet_pton(AF_INET, host, &address.sin_addr) != 1 ||
+            ::connect(this->fd, (sockaddr *)&address, sizeof(address)) != 0)
+        {
+            this->stop();
+            return 0;
+        }
+        fcntl(this->fd, F_SETFL, O_NONBLOCK);
+        this->closed = false;
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        ssize_t sent = this->fd < 0 ? -1 : send(this->fd, buffer, size, MSG_NOSIGNAL);
+        return sent < 0 ? 0 : (size_t)sent;
+    }
+    int available()
+    {
+        if (this->fd < 0)
+        {
+            return 0;
+        }
+        uint8_t buffer[4096];
+        ssize_t peeked = recv(this->fd, buffer, sizeof(buffer), MSG_PEEK);
+        if (peeked == 0)
+        {
+            this->closed = true;
+        }
+        return peeked > 0 ? (int)peeked : 0;
+    }
+    int read(uint8_t *buffer, size_t size)
+    {
+        ssize_t received = this->fd < 0 ? -1 : recv(this->fd, buffer, size, 0);
+        return received > 0 ? (int)received : -1;
+    }
+    void stop()
+    {
+        if (this->fd >= 0)
+        {
+            close(this->fd);
+        }
+        this->fd = -1;
+    }
+    uint8_t connected()
+    {
+        this->available();
+        return this->fd >= 0 && !this->closed;
+    }
+
+private:
+    int fd = -1;
+    bool closed = false;
+};
+
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    void setCACert(const char *) {}
+    void setInsecure() {}
+};
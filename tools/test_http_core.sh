@@ -0,0 +1,23 @@
+#!/bin/bash
+# Builds and runs the HTTP core's host tests against a local server
+# Needs a desktop C++ compiler (g++ or clang++), no Arduino tools
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(dirname "$SCRIPT_DIR")"
+SRC_DIR="$PROJECT_DIR/src/flipper-http"
+TEST_DIR="$PROJECT_DIR/tests/http_core"
+BUILD_DIR="${TMPDIR:-/tmp}/flipper-http-tests"
+CXX="${CXX:-g++}"
+
+echo "=== FlipperHTTP HTTP core tests ==="
+echo ""
+
+mkdir -p "$BUILD_DIR"
+"$CXX" -std=c++11 -Wall -Wextra -Werror -g -pthread \
+    -o "$BUILD_DIR/http_core_test" \
+    "$TEST_DIR/http_core_test.cpp" \
+    "$SRC_DIR/http_core.cpp"
+
+"$BUILD_DIR/http_core_test"